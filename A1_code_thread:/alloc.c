@@ -0,0 +1,245 @@
+/**
+ * Allocation of the big buffers: worlds, and the start world and invasion plans read by main.c.
+ *
+ * With HUGE_PAGES set, buffers of at least HUGE_PAGE_SIZE are mapped with explicit huge pages
+ * (MAP_HUGETLB) if the system has some reserved, and otherwise mapped normally and marked with
+ * madvise(MADV_HUGEPAGE) so that transparent huge pages can back them. Either way a world of a
+ * few hundred MB takes a few hundred TLB entries instead of tens of thousands. Smaller buffers,
+ * and all buffers without HUGE_PAGES, come from the heap.
+ *
+ * Huge pages are physically contiguous, so the rows at the same offset of two worlds would fall
+ * in the same cache sets, and the kernels read one while writing the other. Each mapped buffer
+ * is shifted by a different multiple of COLOUR_STRIDE to keep them apart.
+ *
+ * Every buffer starts with a small header recording how it was allocated, so freeBuffer can
+ * undo it. Buffers are zeroed.
+ *
+ * With ARENA_ALLOCATION set, main.c plans the bytes of the whole run from the input header and
+ * maps them as one arena up front (initArena), pre-faulting its pages (prefaultArena). Buffers are
+ * then carved from the arena in order and freeBuffer leaves them be; the arena is unmapped at
+ * once at the end (freeArena). A buffer that does not fit falls back to the ways above.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "settings.h"
+#include "alloc.h"
+
+enum { FROM_HEAP, FROM_HUGETLB, FROM_TRANSPARENT, FROM_SMALL_PAGES, FROM_ARENA };
+
+typedef struct bufferHeaderStruct {
+    // what to munmap, if mapped
+    void *mapping;
+    size_t mappedSize;
+    int source;
+} bufferHeader;
+
+// keeps the data that follows the header aligned for any cell type
+#define HEADER_SIZE 64
+
+// an odd number of pages and a few cache lines; mapped buffers take turns among COLOURS shifts
+#define COLOUR_STRIDE (33 * 4096 + 3 * 64)
+#define COLOURS 4
+
+// which sources the buffers of at least HUGE_PAGE_SIZE came from, as bits
+static unsigned hugeSources;
+
+typedef struct arenaStruct {
+    char *base;
+    size_t size;
+    // bytes carved so far, and pre-faulted so far
+    size_t used;
+    size_t faulted;
+} arena;
+
+static arena theArena;
+
+#if HUGE_PAGES
+// how many buffers were mapped so far, picks the next shift
+static unsigned nMapped;
+
+/**
+ * Maps size bytes, with huge pages if at all possible. Returns NULL if even a normal mapping fails.
+ */
+static bufferHeader *mapBuffer(size_t size)
+{
+    size_t shift = (size_t) (nMapped % COLOURS) * COLOUR_STRIDE;
+    size_t mappedSize = (size + shift + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *mapping = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    int source = FROM_HUGETLB;
+    char *start = mapping;
+
+    if (mapping == MAP_FAILED)
+    {
+        // transparent huge pages only cover aligned 2 MB extents, so map one more and align the start
+        mappedSize += HUGE_PAGE_SIZE;
+        mapping = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            return NULL;
+        }
+        start = (char *) (((uintptr_t) mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+        source = madvise(start, mappedSize - HUGE_PAGE_SIZE, MADV_HUGEPAGE) == 0
+            ? FROM_TRANSPARENT
+            : FROM_SMALL_PAGES;
+    }
+
+    nMapped++;
+    bufferHeader *header = (bufferHeader *) (start + shift);
+    header->mapping = mapping;
+    header->mappedSize = mappedSize;
+    header->source = source;
+    return header;
+}
+#endif
+
+/**
+ * Returns the bytes of arena an allocBuffer of size takes, header included.
+ */
+size_t arenaBytes(size_t size)
+{
+    return (size + HEADER_SIZE + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+}
+
+/**
+ * Reserves an arena of size bytes to carve the following buffers from. Only address space is
+ * reserved until prefaultArena. Returns -1 if it cannot be mapped, and buffers come from the usual
+ * places then.
+ */
+int initArena(size_t size)
+{
+    size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+#if HUGE_PAGES
+    // the start is only page aligned, so the first and last 2 MB extents may stay small pages
+    if (madvise(base, size, MADV_HUGEPAGE) == 0)
+    {
+        hugeSources |= 1u << FROM_TRANSPARENT;
+    }
+#endif
+    theArena.base = base;
+    theArena.size = size;
+    theArena.used = 0;
+    theArena.faulted = 0;
+    return 0;
+}
+
+/**
+ * Touches the first size bytes of the arena, so the pages behind them are in place before the run
+ * needs them. Calling it again with a larger size touches only the difference.
+ */
+void prefaultArena(size_t size)
+{
+    if (size > theArena.size)
+    {
+        size = theArena.size;
+    }
+    for (size_t offset = theArena.faulted; offset < size; offset += 4096)
+    {
+        // writing 0 keeps the arena zeroed, but faults in a private page rather than the zero page
+        ((volatile char *) theArena.base)[offset] = 0;
+    }
+    if (size > theArena.faulted)
+    {
+        theArena.faulted = size;
+    }
+}
+
+void freeArena(void)
+{
+    if (theArena.base != NULL)
+    {
+        munmap(theArena.base, theArena.size);
+    }
+    theArena = (arena) { 0 };
+}
+
+/**
+ * Returns size zeroed bytes, or NULL if out of memory. Free with freeBuffer.
+ */
+void *allocBuffer(size_t size)
+{
+    bufferHeader *header = NULL;
+    if (theArena.base != NULL && arenaBytes(size) <= theArena.size - theArena.used)
+    {
+        // carved bytes are never handed out twice, so they are still zero
+        header = (bufferHeader *) (theArena.base + theArena.used);
+        header->source = FROM_ARENA;
+        theArena.used += arenaBytes(size);
+        return (char *) header + HEADER_SIZE;
+    }
+#if HUGE_PAGES
+    if (size >= HUGE_PAGE_SIZE)
+    {
+        // failed attempts set errno, which main.c checks while parsing
+        int savedErrno = errno;
+        header = mapBuffer(size + HEADER_SIZE);
+        errno = savedErrno;
+        if (header != NULL)
+        {
+            hugeSources |= 1u << header->source;
+        }
+    }
+#endif
+    if (header == NULL)
+    {
+        header = calloc(1, size + HEADER_SIZE);
+        if (header == NULL)
+        {
+            return NULL;
+        }
+        header->source = FROM_HEAP;
+    }
+    return (char *) header + HEADER_SIZE;
+}
+
+void freeBuffer(void *buffer)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+    bufferHeader *header = (bufferHeader *) ((char *) buffer - HEADER_SIZE);
+    if (header->source == FROM_ARENA)
+    {
+        // goes with the arena
+    }
+    else if (header->source == FROM_HEAP)
+    {
+        free(header);
+    }
+    else
+    {
+        munmap(header->mapping, header->mappedSize);
+    }
+}
+
+/**
+ * Describes the pages behind the buffers of at least HUGE_PAGE_SIZE allocated so far.
+ */
+const char *hugePageReport(void)
+{
+    if (hugeSources == 0)
+    {
+        return "none (no buffer was big enough, or HUGE_PAGES is not set)";
+    }
+    if (hugeSources == 1u << FROM_HUGETLB)
+    {
+        return "hugetlb";
+    }
+    if (hugeSources & (1u << FROM_SMALL_PAGES))
+    {
+        return "small pages (huge pages unavailable)";
+    }
+    if (hugeSources & (1u << FROM_HUGETLB))
+    {
+        return "hugetlb and transparent";
+    }
+    return "transparent";
+}
@@ -0,0 +1,17 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+// with HUGE_PAGES set, buffers at least this big are backed by huge pages
+#define HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+size_t arenaBytes(size_t size);
+int initArena(size_t size);
+void prefaultArena(size_t size);
+void freeArena(void);
+void *allocBuffer(size_t size);
+void freeBuffer(void *buffer);
+const char *hugePageReport(void);
+
+#endif
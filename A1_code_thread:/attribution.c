@@ -0,0 +1,30 @@
+/**
+ * Reports the deaths due to fighting attributed to each invasion, enabled by ATTRIBUTE_DEATHS (see
+ * settings.h). The tiled engine does the attributing (see goiTiled); this only writes the results, one
+ * "<invasion index> <invasion time> <direct> <footprint>" line per invasion, in input order.
+ */
+
+#include <stdio.h>
+#include "attribution.h"
+
+static FILE *attributionFile;
+
+/**
+ * Sets the file reportAttribution writes to. Nothing is reported if file is NULL.
+ */
+void initAttribution(FILE *file)
+{
+    attributionFile = file;
+}
+
+void reportAttribution(const invasionDeaths *deaths, int nInvasions, const int *invasionTimes)
+{
+    if (attributionFile == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < nInvasions; i++)
+    {
+        fprintf(attributionFile, "%d %d %lld %lld\n", i, invasionTimes[i], deaths[i].direct, deaths[i].footprint);
+    }
+}
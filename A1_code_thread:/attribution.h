@@ -0,0 +1,22 @@
+#ifndef ATTRIBUTION_H
+#define ATTRIBUTION_H
+
+#include <stdio.h>
+
+// generations after an invasion lands during which the deaths in its footprint are attributed to it;
+// 0 attributes only the cells it lands on
+#define ATTRIBUTION_WINDOW 8
+
+/**
+ * The deaths due to fighting attributed to one invasion: the live cells it landed on, and the other deaths
+ * in the tiles it landed on, during the ATTRIBUTION_WINDOW generations that followed.
+ */
+typedef struct invasionDeathsStruct {
+    long long direct;
+    long long footprint;
+} invasionDeaths;
+
+void initAttribution(FILE *file);
+void reportAttribution(const invasionDeaths *deaths, int nInvasions, const int *invasionTimes);
+
+#endif
@@ -0,0 +1,164 @@
+/**
+ * Runs many scenarios in one process (see BATCH_RUNS). Scenarios of the same dimensions and generation
+ * count, if small, are simulated ENSEMBLE_LANES at a time by goiEnsemble, and the ensembles are shared
+ * out to the threads. Every other scenario runs on its own through goi, with all the threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "goi.h"
+#include "ensemble.h"
+#include "batch.h"
+
+/**
+ * Up to ENSEMBLE_LANES scenarios simulated together, as indices into the batch.
+ */
+typedef struct ensembleJobStruct {
+    int members[ENSEMBLE_LANES];
+    int nMembers;
+} ensembleJob;
+
+typedef struct batchSharedStruct {
+    const scenario *scenarios;
+    long long *deathTolls;
+    const ensembleJob *jobs;
+    int nJobs;
+    // the next job not taken yet
+    int nextJob;
+    pthread_mutex_t mutex;
+} batchShared;
+
+static const scenario *sortingScenarios;
+
+static int compareShapes(const void *a, const void *b)
+{
+    const scenario *sa = &sortingScenarios[*(const int *) a];
+    const scenario *sb = &sortingScenarios[*(const int *) b];
+    if (sa->nRows != sb->nRows) return sa->nRows < sb->nRows ? -1 : 1;
+    if (sa->nCols != sb->nCols) return sa->nCols < sb->nCols ? -1 : 1;
+    if (sa->nGenerations != sb->nGenerations) return sa->nGenerations < sb->nGenerations ? -1 : 1;
+    // keeps the order stable
+    return *(const int *) a - *(const int *) b;
+}
+
+static bool sameShape(const scenario *a, const scenario *b)
+{
+    return a->nRows == b->nRows && a->nCols == b->nCols && a->nGenerations == b->nGenerations;
+}
+
+static void *batchSubroutine(void *arg)
+{
+    batchShared *shared = (batchShared *) arg;
+    while (true)
+    {
+        pthread_mutex_lock(&shared->mutex);
+        int index = shared->nextJob++;
+        pthread_mutex_unlock(&shared->mutex);
+        if (index >= shared->nJobs)
+        {
+            return NULL;
+        }
+
+        const ensembleJob *job = &shared->jobs[index];
+        scenario members[ENSEMBLE_LANES];
+        long long tolls[ENSEMBLE_LANES];
+        for (int m = 0; m < job->nMembers; m++)
+        {
+            members[m] = shared->scenarios[job->members[m]];
+        }
+        goiEnsemble(members, job->nMembers, tolls);
+        for (int m = 0; m < job->nMembers; m++)
+        {
+            shared->deathTolls[job->members[m]] = tolls[m];
+        }
+    }
+}
+
+/**
+ * Simulates every scenario and stores its death toll into deathTolls, in the same order.
+ */
+void runBatch(int nThreads, const scenario *scenarios, int nScenarios, long long *deathTolls)
+{
+    int *order = malloc(sizeof(int) * nScenarios);
+    // at worst, one job per scenario
+    ensembleJob *jobs = malloc(sizeof(ensembleJob) * nScenarios);
+    bool *alone = malloc(sizeof(bool) * nScenarios);
+    pthread_t *threads = malloc(sizeof(pthread_t) * nThreads);
+    if ((nScenarios > 0 && (order == NULL || jobs == NULL || alone == NULL)) || threads == NULL)
+    {
+        printf("ERROR\n");
+        exit(-1);
+    }
+
+    for (int i = 0; i < nScenarios; i++)
+    {
+        order[i] = i;
+        alone[i] = true;
+    }
+    sortingScenarios = scenarios;
+    qsort(order, nScenarios, sizeof(int), compareShapes);
+
+    // runs of scenarios of the same shape become ensembles of up to ENSEMBLE_LANES
+    int nJobs = 0;
+    for (int start = 0; start < nScenarios;)
+    {
+        const scenario *first = &scenarios[order[start]];
+        int end = start + 1;
+        while (end < nScenarios && end - start < ENSEMBLE_LANES && sameShape(first, &scenarios[order[end]]))
+        {
+            end++;
+        }
+        if (end - start > 1 && (long) first->nRows * first->nCols <= ENSEMBLE_MAX_CELLS)
+        {
+            ensembleJob *job = &jobs[nJobs++];
+            job->nMembers = 0;
+            for (int i = start; i < end; i++)
+            {
+                job->members[job->nMembers++] = order[i];
+                alone[order[i]] = false;
+            }
+        }
+        start = end;
+    }
+
+    batchShared shared;
+    shared.scenarios = scenarios;
+    shared.deathTolls = deathTolls;
+    shared.jobs = jobs;
+    shared.nJobs = nJobs;
+    shared.nextJob = 0;
+    pthread_mutex_init(&shared.mutex, NULL);
+
+    int nWorkers = nThreads < nJobs ? nThreads : nJobs;
+    for (int t = 0; t < nWorkers; t++)
+    {
+        int rc = pthread_create(&threads[t], NULL, &batchSubroutine, (void *) &shared);
+        if (rc)
+        {
+            printf("Error: Return code from pthread_create() is %d\n", rc);
+            exit(-1);
+        }
+    }
+    for (int t = 0; t < nWorkers; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&shared.mutex);
+
+    for (int i = 0; i < nScenarios; i++)
+    {
+        if (alone[i])
+        {
+            const scenario *s = &scenarios[i];
+            deathTolls[i] = goi(nThreads, s->nGenerations, s->startWorld, s->nRows, s->nCols, s->nInvasions,
+                s->invasionTimes, s->invasionPlans);
+        }
+    }
+
+    free(order);
+    free(jobs);
+    free(alone);
+    free(threads);
+}
@@ -0,0 +1,8 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "ensemble.h"
+
+void runBatch(int nThreads, const scenario *scenarios, int nScenarios, long long *deathTolls);
+
+#endif
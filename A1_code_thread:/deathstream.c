@@ -0,0 +1,217 @@
+/**
+ * Streams the deaths due to fighting of every generation as it is simulated, enabled by STREAM_DEATHS (see
+ * settings.h), so that consumers can chart a run or abort it before it ends.
+ *
+ * Each line is "<generation> <deaths> <running total>". The engines call recordDeaths once per generation,
+ * from the thread that drives the simulation and after the workers are done with it, so the step itself
+ * synchronizes with nothing new. Records are appended to one of two batches, and handed to a writing
+ * thread that formats them, writes them and flushes the file: by recordDeaths once the batch is full, or
+ * by the writing thread itself once the batch is DEATH_FLUSH_NS old, even if no record comes after, so a
+ * slow generation shows up as soon as it is done. The simulation only waits if the writer is a whole
+ * batch behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "deathstream.h"
+
+// what a batch holds
+enum { BATCH_FILLING, BATCH_FULL };
+
+typedef struct deathRecordStruct {
+    int generation;
+    long long deaths;
+    long long total;
+} deathRecord;
+
+typedef struct deathBatchStruct {
+    deathRecord records[DEATH_BATCH];
+    int nRecords;
+    int state;
+} deathBatch;
+
+typedef struct deathStreamStruct {
+    FILE *file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    deathBatch batches[2];
+    // the batch recordDeaths fills, and the one the writing thread writes next
+    int nextFill;
+    int nextWrite;
+    bool finished;
+    long long total;
+    // when the first record of the batch being filled came in, on CLOCK_MONOTONIC
+    struct timespec batchStart;
+} deathStream;
+
+static deathStream *theStream;
+
+/**
+ * Marks the batch being filled as full and moves on to the other one. Call with the mutex held.
+ */
+static void closeBatch(deathStream *stream)
+{
+    stream->batches[stream->nextFill].state = BATCH_FULL;
+    stream->nextFill = 1 - stream->nextFill;
+    pthread_cond_broadcast(&stream->changed);
+}
+
+/**
+ * Waits for the next batch to write, closing the batch being filled once it is DEATH_FLUSH_NS old, and
+ * returns it, or NULL once finished and all is written. Call with the mutex held.
+ */
+static deathBatch *nextBatch(deathStream *stream)
+{
+    deathBatch *batch = &stream->batches[stream->nextWrite];
+    // if it is not full, it is the one being filled
+    while (batch->state != BATCH_FULL)
+    {
+        if (batch->nRecords == 0)
+        {
+            if (stream->finished)
+            {
+                return NULL;
+            }
+            pthread_cond_wait(&stream->changed, &stream->mutex);
+            continue;
+        }
+
+        struct timespec deadline = stream->batchStart;
+        deadline.tv_sec += DEATH_FLUSH_NS / 1000000000L;
+        deadline.tv_nsec += DEATH_FLUSH_NS % 1000000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (stream->finished
+            || pthread_cond_timedwait(&stream->changed, &stream->mutex, &deadline) == ETIMEDOUT)
+        {
+            closeBatch(stream);
+        }
+    }
+    return batch;
+}
+
+static void *writeSubroutine(void *arg)
+{
+    deathStream *stream = (deathStream *) arg;
+    while (true)
+    {
+        pthread_mutex_lock(&stream->mutex);
+        deathBatch *batch = nextBatch(stream);
+        pthread_mutex_unlock(&stream->mutex);
+        if (batch == NULL)
+        {
+            return NULL;
+        }
+
+        for (int i = 0; i < batch->nRecords; i++)
+        {
+            const deathRecord *record = &batch->records[i];
+            fprintf(stream->file, "%d %lld %lld\n", record->generation, record->deaths, record->total);
+        }
+        fflush(stream->file);
+
+        pthread_mutex_lock(&stream->mutex);
+        batch->nRecords = 0;
+        batch->state = BATCH_FILLING;
+        stream->nextWrite = 1 - stream->nextWrite;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->mutex);
+    }
+}
+
+/**
+ * Starts the writing thread, which writes records to file. Calls to recordDeaths do nothing if file is NULL.
+ */
+void initDeathStream(FILE *file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    deathStream *stream = calloc(1, sizeof(deathStream));
+    if (stream == NULL)
+    {
+        printf("ERROR\n");
+        exit(-1);
+    }
+    stream->file = file;
+    pthread_mutex_init(&stream->mutex, NULL);
+    // deadlines are taken from CLOCK_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    int rc = pthread_create(&stream->thread, NULL, &writeSubroutine, (void *) stream);
+    if (rc)
+    {
+        printf("Error: Return code from pthread_create() is %d\n", rc);
+        exit(-1);
+    }
+    theStream = stream;
+}
+
+/**
+ * Records the deaths due to fighting of generation. Call once per generation, in order, from one thread.
+ */
+void recordDeaths(int generation, long long deaths)
+{
+    deathStream *stream = theStream;
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    // the writing thread may close the batch being filled at any time, so it is only touched locked
+    pthread_mutex_lock(&stream->mutex);
+    deathBatch *batch = &stream->batches[stream->nextFill];
+    while (batch->state != BATCH_FILLING)
+    {
+        pthread_cond_wait(&stream->changed, &stream->mutex);
+    }
+    if (batch->nRecords == 0)
+    {
+        // start the writing thread's clock
+        clock_gettime(CLOCK_MONOTONIC, &stream->batchStart);
+        pthread_cond_broadcast(&stream->changed);
+    }
+    stream->total += deaths;
+    batch->records[batch->nRecords++] = (deathRecord) { generation, deaths, stream->total };
+    if (batch->nRecords == DEATH_BATCH)
+    {
+        closeBatch(stream);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+/**
+ * Writes what is left and stops the writing thread. Call before closing the file.
+ */
+void finishDeathStream(void)
+{
+    deathStream *stream = theStream;
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    // the writing thread closes the last batch itself
+    pthread_mutex_lock(&stream->mutex);
+    stream->finished = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->mutex);
+    pthread_join(stream->thread, NULL);
+
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->changed);
+    free(stream);
+    theStream = NULL;
+}
@@ -0,0 +1,15 @@
+#ifndef DEATHSTREAM_H
+#define DEATHSTREAM_H
+
+#include <stdio.h>
+
+// records handed to the writing thread at a time
+#define DEATH_BATCH 1024
+// a batch is handed over once it is this old, even if not full, so readers keep up with slow runs
+#define DEATH_FLUSH_NS 100000000L
+
+void initDeathStream(FILE *file);
+void recordDeaths(int generation, long long deaths);
+void finishDeathStream(void);
+
+#endif
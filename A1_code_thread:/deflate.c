@@ -0,0 +1,351 @@
+/**
+ * A small deflate encoder for the exporters (see frames.c), without external libraries.
+ *
+ * It only emits a single block of fixed Huffman codes, and only matches that repeat what came just before:
+ * runs of a byte (distance 1, found by deflateBytes) and runs of a short token (distance of the token's
+ * length, given by the caller to deflateRepeat). Exported worlds are mostly such runs, so that is most of
+ * what full deflate would save there, for a fraction of the work. The output is standard zlib or gzip.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "deflate.h"
+
+// adler32 sums may go this many bytes before they need reducing
+#define ADLER_BLOCK 5552
+#define ADLER_MOD 65521
+// the longest match deflate allows, and the farthest this encoder needs to reach back
+#define MAX_MATCH 258
+#define MAX_TOKEN 8
+
+static uint32_t crcTable[256];
+// the fixed literal/length code, bit reversed as deflate packs it
+static uint16_t symbolCodes[288];
+static uint8_t symbolBits[288];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static const int lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+// the distance code of distances 1 to MAX_TOKEN
+static const int distanceCodes[MAX_TOKEN + 1] = { 0, 0, 1, 2, 3, 4, 4, 5, 5 };
+
+static uint32_t reverseBits(uint32_t code, int n)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < n; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    return reversed;
+}
+
+static void buildTables(void)
+{
+    for (int symbol = 0; symbol < 288; symbol++)
+    {
+        uint32_t code;
+        int n;
+        if (symbol < 144)
+        {
+            code = 0x30 + symbol;
+            n = 8;
+        }
+        else if (symbol < 256)
+        {
+            code = 0x190 + symbol - 144;
+            n = 9;
+        }
+        else if (symbol < 280)
+        {
+            code = symbol - 256;
+            n = 7;
+        }
+        else
+        {
+            code = 0xc0 + symbol - 280;
+            n = 8;
+        }
+        symbolCodes[symbol] = reverseBits(code, n);
+        symbolBits[symbol] = n;
+    }
+
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+        {
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crcBytes(uint32_t crc, const uint8_t *bytes, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        crc = crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/**
+ * Continues the crc32 crc (start from 0xffffffff, and flip the bits of the result) over bytes.
+ */
+uint32_t updateCrc(uint32_t crc, const uint8_t *bytes, size_t n)
+{
+    pthread_once(&tablesOnce, buildTables);
+    return crcBytes(crc, bytes, n);
+}
+
+static void putByte(deflateStream *s, uint8_t byte)
+{
+    if (s->nBytes == s->capacity)
+    {
+        size_t capacity = s->capacity < 4096 ? 4096 : 2 * s->capacity;
+        uint8_t *bytes = realloc(s->bytes, capacity);
+        if (bytes == NULL)
+        {
+            printf("ERROR\n");
+            exit(-1);
+        }
+        s->bytes = bytes;
+        s->capacity = capacity;
+    }
+    s->bytes[s->nBytes++] = byte;
+}
+
+/**
+ * Appends the low n bits of value to the stream, least significant first, as deflate packs them.
+ */
+static void putBits(deflateStream *s, uint32_t value, int n)
+{
+    s->bits |= (uint64_t) value << s->nBits;
+    s->nBits += n;
+    while (s->nBits >= 8)
+    {
+        putByte(s, (uint8_t) s->bits);
+        s->bits >>= 8;
+        s->nBits -= 8;
+    }
+}
+
+/**
+ * Appends symbol 0 to 287 of the fixed literal/length code.
+ */
+static void putSymbol(deflateStream *s, int symbol)
+{
+    putBits(s, symbolCodes[symbol], symbolBits[symbol]);
+}
+
+/**
+ * Appends a copy of the length (3 to MAX_MATCH) bytes that start distance (1 to MAX_TOKEN) bytes back.
+ */
+static void putMatch(deflateStream *s, int length, int distance)
+{
+    int code = 28;
+    while (lengthBase[code] > length)
+    {
+        code--;
+    }
+    putSymbol(s, 257 + code);
+    putBits(s, length - lengthBase[code], lengthExtra[code]);
+    // fixed distance codes are 5 bits; codes 4 and 5 have an extra bit
+    int distanceCode = distanceCodes[distance];
+    putBits(s, reverseBits(distanceCode, 5), 5);
+    if (distanceCode >= 4)
+    {
+        putBits(s, (distance - 1) & 1, 1);
+    }
+}
+
+/**
+ * Appends length copies of what starts distance bytes back, or literals where a match cannot reach.
+ */
+static void putCopies(deflateStream *s, long length, int distance, const uint8_t *source)
+{
+    long done = 0;
+    while (length - done >= 3)
+    {
+        long n = length - done < MAX_MATCH ? length - done : MAX_MATCH;
+        // leave no remainder of 1 or 2 that a match cannot take
+        if (length - done - n > 0 && length - done - n < 3)
+        {
+            n = length - done - 3;
+        }
+        putMatch(s, (int) n, distance);
+        done += n;
+    }
+    for (; done < length; done++)
+    {
+        putSymbol(s, source[done % distance]);
+    }
+}
+
+static void flushRun(deflateStream *s)
+{
+    uint8_t byte = (uint8_t) s->runByte;
+    putCopies(s, s->runLength, 1, &byte);
+    s->runLength = 0;
+}
+
+static void updateChecksum(deflateStream *s, const uint8_t *bytes, size_t n)
+{
+    s->nIn += n;
+    if (s->format == DEFLATE_GZIP)
+    {
+        s->crc = crcBytes(s->crc, bytes, n);
+        return;
+    }
+    for (size_t start = 0; start < n; start += ADLER_BLOCK)
+    {
+        size_t end = start + ADLER_BLOCK < n ? start + ADLER_BLOCK : n;
+        for (size_t i = start; i < end; i++)
+        {
+            s->adlerA += bytes[i];
+            s->adlerB += s->adlerA;
+        }
+        s->adlerA %= ADLER_MOD;
+        s->adlerB %= ADLER_MOD;
+    }
+}
+
+/**
+ * Starts a zlib stream or a gzip member in s, dropping whatever s held. For gzip, extra (nExtra bytes,
+ * can be NULL) goes in the extra field of the header, at offset 12 of bytes.
+ */
+void beginDeflate(deflateStream *s, int format, const uint8_t *extra, size_t nExtra)
+{
+    pthread_once(&tablesOnce, buildTables);
+    s->nBytes = 0;
+    s->format = format;
+    s->bits = 0;
+    s->nBits = 0;
+    s->runByte = -1;
+    s->runLength = 0;
+    s->adlerA = 1;
+    s->adlerB = 0;
+    s->crc = 0xffffffffu;
+    s->nIn = 0;
+
+    if (format == DEFLATE_ZLIB)
+    {
+        // deflate with a 32 KB window, no dictionary
+        putByte(s, 0x78);
+        putByte(s, 0x01);
+    }
+    else
+    {
+        // deflate, FEXTRA if there is extra, no time stamp, unknown OS
+        static const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+        for (int i = 0; i < 10; i++)
+        {
+            putByte(s, header[i]);
+        }
+        if (extra != NULL)
+        {
+            s->bytes[3] = 4;
+            putByte(s, nExtra & 0xff);
+            putByte(s, nExtra >> 8);
+            for (size_t i = 0; i < nExtra; i++)
+            {
+                putByte(s, extra[i]);
+            }
+        }
+    }
+    // a single final block of fixed Huffman codes
+    putBits(s, 1, 1);
+    putBits(s, 1, 2);
+}
+
+/**
+ * Encodes n bytes.
+ */
+void deflateBytes(deflateStream *s, const uint8_t *bytes, size_t n)
+{
+    updateChecksum(s, bytes, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        int byte = bytes[i];
+        if (byte == s->runByte)
+        {
+            s->runLength++;
+            continue;
+        }
+        flushRun(s);
+        putSymbol(s, byte);
+        s->runByte = byte;
+    }
+}
+
+/**
+ * Encodes count copies of token, length (1 to 8) bytes long.
+ */
+void deflateRepeat(deflateStream *s, const uint8_t *token, int length, long count)
+{
+    if (length > MAX_TOKEN)
+    {
+        for (long i = 0; i < count; i++)
+        {
+            deflateBytes(s, token, length);
+        }
+        return;
+    }
+    if (count <= 0)
+    {
+        return;
+    }
+    deflateBytes(s, token, length);
+    for (long i = 1; i < count; i++)
+    {
+        updateChecksum(s, token, length);
+    }
+    flushRun(s);
+    putCopies(s, (count - 1) * length, length, token);
+    // the last byte out is the token's last, whatever the copies came to
+    s->runByte = token[length - 1];
+}
+
+/**
+ * Ends the stream with its checksum; bytes then holds the rest of it.
+ */
+void endDeflate(deflateStream *s)
+{
+    flushRun(s);
+    putSymbol(s, 256);
+    putBits(s, 0, (8 - s->nBits) % 8);
+
+    if (s->format == DEFLATE_ZLIB)
+    {
+        uint32_t adler = (s->adlerB << 16) | s->adlerA;
+        // big endian
+        for (int i = 3; i >= 0; i--)
+        {
+            putByte(s, adler >> (8 * i));
+        }
+        return;
+    }
+    uint32_t words[2] = { s->crc ^ 0xffffffffu, (uint32_t) s->nIn };
+    // little endian
+    for (int w = 0; w < 2; w++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            putByte(s, words[w] >> (8 * i));
+        }
+    }
+}
+
+void freeDeflate(deflateStream *s)
+{
+    free(s->bytes);
+    s->bytes = NULL;
+    s->capacity = 0;
+    s->nBytes = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the wrapper around the deflate data: zlib (as in PNG) or a gzip member
+enum { DEFLATE_ZLIB, DEFLATE_GZIP };
+
+/**
+ * A deflate stream being encoded. bytes holds the nBytes encoded so far; callers may take them out and
+ * reset nBytes to 0 between calls. Zero it before its first beginDeflate.
+ */
+typedef struct deflateStreamStruct {
+    uint8_t *bytes;
+    size_t nBytes;
+    size_t capacity;
+    int format;
+    uint64_t bits;
+    int nBits;
+    // the byte the current run repeats, and how many more times it did so
+    int runByte;
+    long runLength;
+    // checksum of the uncompressed bytes: adler32 for zlib, crc32 for gzip
+    uint32_t adlerA;
+    uint32_t adlerB;
+    uint32_t crc;
+    uint64_t nIn;
+} deflateStream;
+
+uint32_t updateCrc(uint32_t crc, const uint8_t *bytes, size_t n);
+
+void beginDeflate(deflateStream *s, int format, const uint8_t *extra, size_t nExtra);
+void deflateBytes(deflateStream *s, const uint8_t *bytes, size_t n);
+void deflateRepeat(deflateStream *s, const uint8_t *token, int length, long count);
+void endDeflate(deflateStream *s);
+void freeDeflate(deflateStream *s);
+
+#endif
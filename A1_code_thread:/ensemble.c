@@ -0,0 +1,233 @@
+/**
+ * Engine that advances up to ENSEMBLE_LANES scenarios of the same dimensions and generation count in
+ * lockstep (see batch.c, which groups them).
+ *
+ * The worlds are interleaved cell by cell: a cell of the ensemble is a vector of ENSEMBLE_LANES cells,
+ * one per scenario, so every operation of the kernel below advances all the scenarios at once. The rule
+ * is evaluated without branches on masks, since the lanes seldom agree. Each lane has its own invasion
+ * schedule and death toll; lanes without a scenario stay dead.
+ *
+ * Cells hold faction ids as read, not dense ids, since the lanes do not share their factions. The
+ * rules of isBirthable, isSurvivable and willFight are hardwired into stepEnsembleRow; keep them in
+ * sync with kernel.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "util.h"
+#include "settings.h"
+#include "goi.h"
+#include "alloc.h"
+#include "ensemble.h"
+
+/**
+ * One cell of every lane. Comparisons yield all ones in the lanes where they hold, which is -1, so
+ * subtracting them counts.
+ */
+typedef cell_t lanes __attribute__((vector_size(ENSEMBLE_LANES * sizeof(cell_t))));
+
+// death counts are flushed from the lanes before they can overflow a cell_t
+#define FLUSH_COLS 255
+
+static inline lanes loadLanes(const cell_t *cells)
+{
+    lanes v;
+    memcpy(&v, cells, sizeof(v));
+    return v;
+}
+
+static inline lanes maxLanes(lanes a, lanes b)
+{
+    lanes aIsGreater = (lanes) (a > b);
+    return (a & aIsGreater) | (b & ~aIsGreater);
+}
+
+static inline bool anyLane(lanes v)
+{
+    uint64_t words[sizeof(lanes) / sizeof(uint64_t)];
+    memcpy(words, &v, sizeof(v));
+    uint64_t any = 0;
+    for (size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++)
+    {
+        any |= words[w];
+    }
+    return any != 0;
+}
+
+/**
+ * Returns a pointer to the lanes of the cell at column 0 of row of a padded, interleaved grid; row may be
+ * -1 or nRows to reach the border.
+ */
+static cell_t *laneRow(cell_t *grid, int nCols, int row)
+{
+    return grid + ((size_t) (row + 1) * (nCols + 2) + 1) * ENSEMBLE_LANES;
+}
+
+/**
+ * Computes the next state of row into newRow, given the interleaved rows above and below it and
+ * (optionally, can be NULL) the interleaved invasion row landing this generation. Adds the deaths of
+ * each lane to deaths.
+ */
+static void stepEnsembleRow(const cell_t *above, const cell_t *row, const cell_t *below, const cell_t *invaders,
+    cell_t *newRow, int nCols, long long *deaths)
+{
+    for (int startCol = 0; startCol < nCols; startCol += FLUSH_COLS)
+    {
+        int endCol = startCol + FLUSH_COLS < nCols ? startCol + FLUSH_COLS : nCols;
+        lanes rowDeaths = { 0 };
+
+        for (int col = startCol; col < endCol; col++)
+        {
+            const cell_t *a = above + (size_t) col * ENSEMBLE_LANES;
+            const cell_t *r = row + (size_t) col * ENSEMBLE_LANES;
+            const cell_t *b = below + (size_t) col * ENSEMBLE_LANES;
+            lanes neighbors[8] = {
+                loadLanes(a - ENSEMBLE_LANES), loadLanes(a), loadLanes(a + ENSEMBLE_LANES),
+                loadLanes(r - ENSEMBLE_LANES), loadLanes(r + ENSEMBLE_LANES),
+                loadLanes(b - ENSEMBLE_LANES), loadLanes(b), loadLanes(b + ENSEMBLE_LANES)
+            };
+            lanes cell = loadLanes(r);
+
+            lanes liveCount = { 0 };
+            lanes friendlyCount = { 0 };
+            for (int i = 0; i < 8; i++)
+            {
+                liveCount -= (lanes) (neighbors[i] != DEAD_FACTION);
+                friendlyCount -= (lanes) (neighbors[i] == cell);
+            }
+
+            lanes alive = (lanes) (cell != DEAD_FACTION);
+            lanes fights = alive & (lanes) (liveCount != friendlyCount);
+            lanes survives = alive & ~fights & ((lanes) (friendlyCount == 2) | (lanes) (friendlyCount == 3));
+
+            // need exactly 3 of a single faction; the highest such faction wins
+            lanes born = { 0 };
+            if (anyLane(~alive & (lanes) (liveCount >= 3)))
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    lanes count = { 0 };
+                    for (int j = 0; j < 8; j++)
+                    {
+                        count -= (lanes) (neighbors[j] == neighbors[i]);
+                    }
+                    born = maxLanes(born, neighbors[i] & (lanes) (count == 3));
+                }
+                born &= ~alive;
+            }
+
+            lanes next = (cell & survives) | born;
+            lanes died = fights;
+            if (invaders != NULL)
+            {
+                lanes inv = loadLanes(invaders + (size_t) col * ENSEMBLE_LANES);
+                lanes landed = (lanes) (inv != DEAD_FACTION);
+                died = (fights & ~landed) | (alive & landed);
+                next = (inv & landed) | (next & ~landed);
+            }
+            rowDeaths -= died;
+            memcpy(newRow + (size_t) col * ENSEMBLE_LANES, &next, sizeof(next));
+        }
+
+        for (int lane = 0; lane < ENSEMBLE_LANES; lane++)
+        {
+            deaths[lane] += rowDeaths[lane];
+        }
+    }
+}
+
+/**
+ * Writes the cells of grid into lane of the interleaved padded grid.
+ */
+static void interleave(const int *grid, cell_t *lanesGrid, int lane, int nRows, int nCols)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        cell_t *out = laneRow(lanesGrid, nCols, row) + lane;
+        for (int col = 0; col < nCols; col++)
+        {
+            int faction = getValueAt(grid, nRows, nCols, row, col);
+            out[(size_t) col * ENSEMBLE_LANES] = faction > DEAD_FACTION && faction < MAX_FACTIONS ? faction : DEAD_FACTION;
+        }
+    }
+}
+
+/**
+ * Simulates nScenarios (at most ENSEMBLE_LANES) scenarios that share nGenerations, nRows and nCols, and
+ * stores the death toll of each into deathTolls, as goi would for each on its own. Runs on the calling
+ * thread only.
+ */
+void goiEnsemble(const scenario *scenarios, int nScenarios, long long *deathTolls)
+{
+    int nGenerations = scenarios[0].nGenerations;
+    int nRows = scenarios[0].nRows;
+    int nCols = scenarios[0].nCols;
+
+    size_t gridSize = (size_t) (nRows + 2) * (nCols + 2) * ENSEMBLE_LANES * sizeof(cell_t);
+    cell_t *world = allocBuffer(gridSize);
+    cell_t *newWorld = allocBuffer(gridSize);
+    cell_t *inv = allocBuffer(gridSize);
+    if (world == NULL || newWorld == NULL || inv == NULL)
+    {
+        printf("ERROR\n");
+        exit(-1);
+    }
+
+    long long deaths[ENSEMBLE_LANES] = { 0 };
+    int invasionIndex[ENSEMBLE_LANES] = { 0 };
+    for (int lane = 0; lane < nScenarios; lane++)
+    {
+        interleave(scenarios[lane].startWorld, world, lane, nRows, nCols);
+    }
+
+    for (int i = 1; i <= nGenerations; i++)
+    {
+        // does an invasion land in any lane this generation?
+        const int *plans[ENSEMBLE_LANES] = { NULL };
+        bool invaded = false;
+        for (int lane = 0; lane < nScenarios; lane++)
+        {
+            const scenario *s = &scenarios[lane];
+            if (invasionIndex[lane] < s->nInvasions && i == s->invasionTimes[invasionIndex[lane]])
+            {
+                plans[lane] = s->invasionPlans[invasionIndex[lane]];
+                invasionIndex[lane]++;
+                invaded = true;
+            }
+        }
+        if (invaded)
+        {
+            // the other lanes may still hold an earlier plan
+            memset(inv, 0, gridSize);
+            for (int lane = 0; lane < nScenarios; lane++)
+            {
+                if (plans[lane] != NULL)
+                {
+                    interleave(plans[lane], inv, lane, nRows, nCols);
+                }
+            }
+        }
+
+        for (int row = 0; row < nRows; row++)
+        {
+            stepEnsembleRow(laneRow(world, nCols, row - 1), laneRow(world, nCols, row), laneRow(world, nCols, row + 1),
+                invaded ? laneRow(inv, nCols, row) : NULL, laneRow(newWorld, nCols, row), nCols, deaths);
+        }
+
+        cell_t *tmp = world;
+        world = newWorld;
+        newWorld = tmp;
+    }
+
+    for (int lane = 0; lane < nScenarios; lane++)
+    {
+        deathTolls[lane] = deaths[lane];
+    }
+
+    freeBuffer(world);
+    freeBuffer(newWorld);
+    freeBuffer(inv);
+}
@@ -0,0 +1,26 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "goi.h"
+
+// scenarios an ensemble advances together, one per cell of a 128-bit vector
+#define ENSEMBLE_LANES (16 / (int) sizeof(cell_t))
+// scenarios bigger than this (in cells) gain more from running on their own with threads
+#define ENSEMBLE_MAX_CELLS (256 * 256)
+
+/**
+ * A scenario as read from one input file.
+ */
+typedef struct scenarioStruct {
+    int nGenerations;
+    int nRows;
+    int nCols;
+    int *startWorld;
+    int nInvasions;
+    int *invasionTimes;
+    int **invasionPlans;
+} scenario;
+
+void goiEnsemble(const scenario *scenarios, int nScenarios, long long *deathTolls);
+
+#endif
@@ -0,0 +1,463 @@
+/**
+ * Asynchronous export of generations, for the formats other than plain JSON: image frames, enabled by
+ * EXPORT_FRAMES, and compressed JSON, enabled by EXPORT_COMPRESSION (see settings.h).
+ *
+ * Frames are binary PPM or PNG, concatenated into the export file, which ffmpeg reads as is with
+ * -f image2pipe. Each cell is a FRAME_CELL_PIXELS square of its faction's colour; dead cells are black.
+ *
+ * Compressed JSON is the JSON of exporter.c, each generation a gzip member of its own, so gunzip or zcat
+ * give back the JSON export exactly. Members do not refer to each other, and the extra field of each
+ * header gives its size and generation (see JSON_BLOCK_ID), so a reader can hop from header to header
+ * to the generation it wants and only inflate that one.
+ *
+ * exportFrame only copies the world into one of two slots and returns, so the simulation waits on the
+ * exporter only if it is two generations ahead. The rest happens on an encoding thread, a row at a time.
+ * For PNG the row is rendered, filtered (Sub or Up, whichever leaves smaller bytes) and deflated; for
+ * JSON, runs of equal cells are handed to the encoder as repeats of one token (see deflate.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "settings.h"
+#include "goi.h"
+#include "deflate.h"
+#include "frames.h"
+#include "exporter.h"
+
+// as in exporter.c
+#define JSON_KEY "\"world\""
+// the extra field of a compressed JSON member: this id and a 2 byte length, then the member's size in
+// bytes (8 bytes) and generation (4 bytes), little endian
+#define JSON_BLOCK_ID "GO"
+#define JSON_EXTRA_SIZE 16
+// where the size lands in the member, past the gzip header and the id and length of the extra field
+#define JSON_EXTRA_OFFSET 16
+
+// what a slot holds
+enum { SLOT_FREE, SLOT_FULL };
+
+typedef struct frameSlotStruct {
+    int *world;
+    size_t capacity;
+    int nRows;
+    int nCols;
+    int state;
+} frameSlot;
+
+typedef struct frameExporterStruct {
+    FILE *file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    frameSlot slots[2];
+    // the slot exportFrame fills next, and the one the encoding thread reads next
+    int nextFill;
+    int nextEncode;
+    bool finished;
+    // the colours of all factions, 3 bytes each
+    uint8_t palette[MAX_FACTIONS * 3];
+    // the encoding thread's deflate output, and the generation it encodes
+    deflateStream stream;
+    int generation;
+} frameExporter;
+
+static frameExporter *theExporter;
+
+static void putBigEndian(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void putLittleEndian(uint8_t *out, uint64_t value, int nBytes)
+{
+    for (int i = 0; i < nBytes; i++)
+    {
+        out[i] = value >> (8 * i);
+    }
+}
+
+static void writeChunk(FILE *file, const char *type, const uint8_t *data, size_t n)
+{
+    uint8_t header[8];
+    putBigEndian(header, (uint32_t) n);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = updateCrc(0xffffffffu, header + 4, 4);
+    crc = updateCrc(crc, data, n) ^ 0xffffffffu;
+    uint8_t trailer[4];
+    putBigEndian(trailer, crc);
+    fwrite(header, 1, 8, file);
+    fwrite(data, 1, n, file);
+    fwrite(trailer, 1, 4, file);
+}
+
+/**
+ * Renders row of world into pixels, FRAME_CELL_PIXELS pixels a cell and 3 bytes a pixel.
+ */
+static void renderRow(const frameExporter *exporter, const int *world, int nCols, int row, uint8_t *pixels)
+{
+    const int *cells = world + (size_t) row * nCols;
+    for (int col = 0; col < nCols; col++)
+    {
+        int faction = cells[col] > DEAD_FACTION && cells[col] < MAX_FACTIONS ? cells[col] : DEAD_FACTION;
+        const uint8_t *colour = &exporter->palette[faction * 3];
+        for (int p = 0; p < FRAME_CELL_PIXELS; p++)
+        {
+            memcpy(pixels, colour, 3);
+            pixels += 3;
+        }
+    }
+}
+
+static void writePpm(frameExporter *exporter, const frameSlot *slot, uint8_t *pixels)
+{
+    int width = slot->nCols * FRAME_CELL_PIXELS;
+    size_t rowBytes = (size_t) width * 3;
+    fprintf(exporter->file, "P6\n%d %d\n255\n", width, slot->nRows * FRAME_CELL_PIXELS);
+    for (int row = 0; row < slot->nRows; row++)
+    {
+        renderRow(exporter, slot->world, slot->nCols, row, pixels);
+        for (int p = 0; p < FRAME_CELL_PIXELS; p++)
+        {
+            fwrite(pixels, 1, rowBytes, exporter->file);
+        }
+    }
+}
+
+/**
+ * Encodes one filtered scanline: Sub or Up, whichever sums to the smaller absolute bytes.
+ */
+static void filterRow(deflateStream *s, const uint8_t *pixels, const uint8_t *previous, size_t rowBytes, uint8_t *filtered)
+{
+    long subCost = 0;
+    long upCost = 0;
+    for (size_t i = 0; i < rowBytes; i++)
+    {
+        int8_t sub = (int8_t) (pixels[i] - (i >= 3 ? pixels[i - 3] : 0));
+        int8_t up = (int8_t) (pixels[i] - previous[i]);
+        subCost += sub < 0 ? -sub : sub;
+        upCost += up < 0 ? -up : up;
+    }
+    bool useUp = upCost <= subCost;
+    filtered[0] = useUp ? 2 : 1;
+    for (size_t i = 0; i < rowBytes; i++)
+    {
+        filtered[i + 1] = useUp ? pixels[i] - previous[i] : pixels[i] - (i >= 3 ? pixels[i - 3] : 0);
+    }
+    deflateBytes(s, filtered, rowBytes + 1);
+}
+
+static void writePng(frameExporter *exporter, const frameSlot *slot, uint8_t *pixels, uint8_t *previous,
+    uint8_t *filtered)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    int width = slot->nCols * FRAME_CELL_PIXELS;
+    size_t rowBytes = (size_t) width * 3;
+    fwrite(signature, 1, 8, exporter->file);
+
+    // 8 bits a channel, RGB, no interlace
+    uint8_t header[13] = { 0 };
+    putBigEndian(header, width);
+    putBigEndian(header + 4, slot->nRows * FRAME_CELL_PIXELS);
+    header[8] = 8;
+    header[9] = 2;
+    writeChunk(exporter->file, "IHDR", header, sizeof(header));
+
+    deflateStream *s = &exporter->stream;
+    beginDeflate(s, DEFLATE_ZLIB, NULL, 0);
+    // the row above the first one counts as black for Up
+    memset(previous, 0, rowBytes);
+    for (int row = 0; row < slot->nRows; row++)
+    {
+        renderRow(exporter, slot->world, slot->nCols, row, pixels);
+        for (int p = 0; p < FRAME_CELL_PIXELS; p++)
+        {
+            filterRow(s, pixels, previous, rowBytes, filtered);
+            memcpy(previous, pixels, rowBytes);
+        }
+        if (s->nBytes >= PNG_CHUNK_SIZE)
+        {
+            writeChunk(exporter->file, "IDAT", s->bytes, s->nBytes);
+            s->nBytes = 0;
+        }
+    }
+    endDeflate(s);
+    writeChunk(exporter->file, "IDAT", s->bytes, s->nBytes);
+    writeChunk(exporter->file, "IEND", NULL, 0);
+}
+
+/**
+ * Writes value in decimal to out, and returns how many characters that took.
+ */
+static int formatCell(int value, uint8_t *out)
+{
+    char digits[16];
+    int n = snprintf(digits, sizeof(digits), "%d", value);
+    memcpy(out, digits, n);
+    return n;
+}
+
+/**
+ * Writes the world of slot as the JSON of exporter.c, in a gzip member of its own.
+ */
+static void writeCompressedJson(frameExporter *exporter, const frameSlot *slot)
+{
+    static const char *open = "{" JSON_KEY ":[";
+    static const char *close = "]}\n";
+    // the member's size and generation are filled in at the end
+    uint8_t extra[JSON_EXTRA_SIZE] = { JSON_BLOCK_ID[0], JSON_BLOCK_ID[1], JSON_EXTRA_SIZE - 4, 0 };
+
+    deflateStream *s = &exporter->stream;
+    beginDeflate(s, DEFLATE_GZIP, extra, sizeof(extra));
+    deflateBytes(s, (const uint8_t *) open, strlen(open));
+    for (int row = 0; row < slot->nRows; row++)
+    {
+        const int *cells = slot->world + (size_t) row * slot->nCols;
+        deflateBytes(s, (const uint8_t *) "[", 1);
+        for (int col = 0; col < slot->nCols;)
+        {
+            int end = col + 1;
+            while (end < slot->nCols && cells[end] == cells[col])
+            {
+                end++;
+            }
+            // the cell and its comma; the last cell of a row has none
+            uint8_t token[16];
+            int length = formatCell(cells[col], token);
+            token[length] = ',';
+            if (end < slot->nCols)
+            {
+                deflateRepeat(s, token, length + 1, end - col);
+            }
+            else
+            {
+                deflateRepeat(s, token, length + 1, end - col - 1);
+                deflateBytes(s, token, length);
+            }
+            col = end;
+        }
+        if (row != slot->nRows - 1)
+        {
+            deflateBytes(s, (const uint8_t *) "],", 2);
+        }
+        else
+        {
+            deflateBytes(s, (const uint8_t *) "]", 1);
+        }
+    }
+    deflateBytes(s, (const uint8_t *) close, strlen(close));
+    endDeflate(s);
+
+    putLittleEndian(s->bytes + JSON_EXTRA_OFFSET, s->nBytes, 8);
+    putLittleEndian(s->bytes + JSON_EXTRA_OFFSET + 8, exporter->generation, 4);
+    fwrite(s->bytes, 1, s->nBytes, exporter->file);
+}
+
+static void *encodeSubroutine(void *arg)
+{
+    frameExporter *exporter = (frameExporter *) arg;
+    uint8_t *pixels = NULL;
+    uint8_t *previous = NULL;
+    uint8_t *filtered = NULL;
+    size_t rowCapacity = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&exporter->mutex);
+        frameSlot *slot = &exporter->slots[exporter->nextEncode];
+        while (slot->state != SLOT_FULL && !exporter->finished)
+        {
+            pthread_cond_wait(&exporter->changed, &exporter->mutex);
+        }
+        bool haveFrame = slot->state == SLOT_FULL;
+        pthread_mutex_unlock(&exporter->mutex);
+        if (!haveFrame)
+        {
+            break;
+        }
+
+        size_t rowBytes = (size_t) slot->nCols * FRAME_CELL_PIXELS * 3;
+        if (rowBytes > rowCapacity)
+        {
+            free(pixels);
+            free(previous);
+            free(filtered);
+            pixels = malloc(rowBytes);
+            previous = malloc(rowBytes);
+            filtered = malloc(rowBytes + 1);
+            if (pixels == NULL || previous == NULL || filtered == NULL)
+            {
+                printf("ERROR\n");
+                exit(-1);
+            }
+            rowCapacity = rowBytes;
+        }
+        if (EXPORT_FRAMES == 1)
+        {
+            writePpm(exporter, slot, pixels);
+        }
+        else if (EXPORT_FRAMES == 2)
+        {
+            writePng(exporter, slot, pixels, previous, filtered);
+        }
+        else
+        {
+            writeCompressedJson(exporter, slot);
+        }
+        exporter->generation++;
+
+        pthread_mutex_lock(&exporter->mutex);
+        slot->state = SLOT_FREE;
+        exporter->nextEncode = 1 - exporter->nextEncode;
+        pthread_cond_broadcast(&exporter->changed);
+        pthread_mutex_unlock(&exporter->mutex);
+    }
+
+    free(pixels);
+    free(previous);
+    free(filtered);
+    freeDeflate(&exporter->stream);
+    return NULL;
+}
+
+/**
+ * Picks a bright colour for each faction, spreading the hues of consecutive factions by the golden ratio
+ * so that neighbors in number do not look alike.
+ */
+static void buildPalette(uint8_t *palette)
+{
+    memset(palette, 0, 3);
+    for (int faction = 1; faction < MAX_FACTIONS; faction++)
+    {
+        // hue in sixths of the colour wheel, 8 bits of fraction
+        int hue = (int) ((uint32_t) (faction * 2654435769u) >> 16) * 6 >> 8;
+        int sector = hue >> 8;
+        int rising = 64 + (hue & 0xff) * 191 / 255;
+        int falling = 255 + 64 - rising;
+        int rgb[6][3] = {
+            { 255, rising, 64 }, { falling, 255, 64 }, { 64, 255, rising },
+            { 64, falling, 255 }, { rising, 64, 255 }, { 255, 64, falling }
+        };
+        for (int c = 0; c < 3; c++)
+        {
+            palette[faction * 3 + c] = rgb[sector][c];
+        }
+    }
+}
+
+/**
+ * Starts the encoding thread, which writes generations to file. Calls to exportFrame do nothing if file is NULL.
+ */
+void initFrameExporter(FILE *file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    frameExporter *exporter = calloc(1, sizeof(frameExporter));
+    if (exporter == NULL)
+    {
+        printf("ERROR\n");
+        exit(-1);
+    }
+    exporter->file = file;
+    buildPalette(exporter->palette);
+    pthread_mutex_init(&exporter->mutex, NULL);
+    pthread_cond_init(&exporter->changed, NULL);
+    int rc = pthread_create(&exporter->thread, NULL, &encodeSubroutine, (void *) exporter);
+    if (rc)
+    {
+        printf("Error: Return code from pthread_create() is %d\n", rc);
+        exit(-1);
+    }
+    theExporter = exporter;
+}
+
+/**
+ * Queues world, with its original factions, as the next frame. Waits only while both slots are taken.
+ */
+void exportFrame(const int *world, int nRows, int nCols)
+{
+    frameExporter *exporter = theExporter;
+    if (exporter == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&exporter->mutex);
+    frameSlot *slot = &exporter->slots[exporter->nextFill];
+    while (slot->state != SLOT_FREE)
+    {
+        pthread_cond_wait(&exporter->changed, &exporter->mutex);
+    }
+    pthread_mutex_unlock(&exporter->mutex);
+
+    // the encoding thread leaves a free slot alone
+    size_t nCells = (size_t) nRows * nCols;
+    if (nCells > slot->capacity)
+    {
+        free(slot->world);
+        slot->world = malloc(sizeof(int) * nCells);
+        if (slot->world == NULL)
+        {
+            printf("ERROR\n");
+            exit(-1);
+        }
+        slot->capacity = nCells;
+    }
+    memcpy(slot->world, world, sizeof(int) * nCells);
+    slot->nRows = nRows;
+    slot->nCols = nCols;
+
+    pthread_mutex_lock(&exporter->mutex);
+    slot->state = SLOT_FULL;
+    exporter->nextFill = 1 - exporter->nextFill;
+    pthread_cond_broadcast(&exporter->changed);
+    pthread_mutex_unlock(&exporter->mutex);
+}
+
+/**
+ * Exports a generation in the format the settings select: with exportFrame, or as plain JSON with
+ * exportWorld of exporter.c. The engines export through this.
+ */
+void exportGeneration(const int *world, int nRows, int nCols)
+{
+#if EXPORT_FRAMES || EXPORT_COMPRESSION
+    exportFrame(world, nRows, nCols);
+#else
+    exportWorld(world, nRows, nCols);
+#endif
+}
+
+/**
+ * Waits for the queued frames to be written and stops the encoding thread. Call before closing the file.
+ */
+void finishFrameExporter(void)
+{
+    frameExporter *exporter = theExporter;
+    if (exporter == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&exporter->mutex);
+    exporter->finished = true;
+    pthread_cond_broadcast(&exporter->changed);
+    pthread_mutex_unlock(&exporter->mutex);
+    pthread_join(exporter->thread, NULL);
+
+    for (int i = 0; i < 2; i++)
+    {
+        free(exporter->slots[i].world);
+    }
+    pthread_mutex_destroy(&exporter->mutex);
+    pthread_cond_destroy(&exporter->changed);
+    free(exporter);
+    theExporter = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdio.h>
+
+// each cell is drawn as a square of this many pixels a side
+#define FRAME_CELL_PIXELS 1
+// frames of PNG are written in IDAT chunks of about this many bytes
+#define PNG_CHUNK_SIZE (1 << 20)
+
+void initFrameExporter(FILE *file);
+void exportFrame(const int *world, int nRows, int nCols);
+void exportGeneration(const int *world, int nRows, int nCols);
+void finishFrameExporter(void);
+
+#endif
@@ -7,186 +7,465 @@
 #include <pthread.h>
 #include <math.h>
 #include "util.h"
-#include "exporter.h"
+#include "frames.h"
 #include "settings.h"
+#include "goi.h"
+#include "tiny.h"
+#include "kernel.h"
+#include "tiled.h"
+#include "memo.h"
+#include "hashset.h"
+#include "alloc.h"
+#include "treebarrier.h"
+#include "deathstream.h"
+
+// worlds narrower than this, and at least twice as tall, are simulated transposed (see shouldTranspose)
+#define TRANSPOSE_BELOW_COLS 64
+
+box emptyBox(int nRows, int nCols) {
+    box b = { nRows, -1, nCols, -1 };
+    return b;
+}
+
+bool isEmptyBox(box b) {
+    return b.minRow > b.maxRow || b.minCol > b.maxCol;
+}
 
-// including the "dead faction": 0
-#define MAX_FACTIONS 10
+void addToBox(box* b, int row, int col) {
+    if (row < b->minRow) b->minRow = row;
+    if (row > b->maxRow) b->maxRow = row;
+    if (col < b->minCol) b->minCol = col;
+    if (col > b->maxCol) b->maxCol = col;
+}
 
-// this macro is here to make the code slightly more readable, not because it can be safely changed to
-// any integer value; changing this to a non-zero value may break the code
-#define DEAD_FACTION 0
+box unionBox(box a, box b) {
+    if (isEmptyBox(a)) return b;
+    if (isEmptyBox(b)) return a;
+    box u = {
+        a.minRow < b.minRow ? a.minRow : b.minRow,
+        a.maxRow > b.maxRow ? a.maxRow : b.maxRow,
+        a.minCol < b.minCol ? a.minCol : b.minCol,
+        a.maxCol > b.maxCol ? a.maxCol : b.maxCol
+    };
+    return u;
+}
 
 /**
- * Specifies the number(s) of live neighbors of the same faction required for a dead cell to become alive.
+ * Grows a non-empty box by one cell in every direction, clipped to the world.
  */
-bool isBirthable(int n)
-{
-    return n == 3;
+box growBox(box b, int nRows, int nCols) {
+    if (isEmptyBox(b)) return b;
+    box g = {
+        b.minRow > 0 ? b.minRow - 1 : 0,
+        b.maxRow < nRows - 1 ? b.maxRow + 1 : nRows - 1,
+        b.minCol > 0 ? b.minCol - 1 : 0,
+        b.maxCol < nCols - 1 ? b.maxCol + 1 : nCols - 1
+    };
+    return g;
 }
 
 /**
- * Specifies the number(s) of live neighbors of the same faction required for a live cell to remain alive.
+ * Returns the bounding box of the non-dead cells of the padded grid.
  */
-bool isSurvivable(int n)
-{
-    return n == 2 || n == 3;
+box findLiveBox(cell_t *grid, int nRows, int nCols) {
+    box b = emptyBox(nRows, nCols);
+    for (int row = 0; row < nRows; row++) {
+        const cell_t *cells = paddedRow(grid, nCols, row);
+        for (int col = 0; col < nCols; col++) {
+            if (cells[col] != DEAD_FACTION) {
+                addToBox(&b, row, col);
+            }
+        }
+    }
+    return b;
 }
 
 /**
- * Specifies the number of live neighbors of a different faction required for a live cell to die due to fighting.
+ * Returns the bounding box of the non-dead cells of plan (as given to goi), in simulated coordinates.
  */
-bool willFight(int n) {
-    return n > 0;
+box findPlanBox(const int *plan, int nRows, int nCols, const factionMap *map) {
+    int planRows = map->transposed ? nCols : nRows;
+    int planCols = map->transposed ? nRows : nCols;
+    box b = emptyBox(planRows, planCols);
+    for (int row = 0; row < planRows; row++) {
+        for (int col = 0; col < planCols; col++) {
+            if (getValueAt(plan, planRows, planCols, row, col) != DEAD_FACTION) {
+                addToBox(&b, row, col);
+            }
+        }
+    }
+    if (map->transposed) {
+        box t = { b.minCol, b.maxCol, b.minRow, b.maxRow };
+        return t;
+    }
+    return b;
 }
 
 /**
- * Computes and returns the next state of the cell specified by row and col based on currWorld and invaders. Sets *diedDueToFighting to
- * true if this cell should count towards the death toll due to fighting.
- * 
- * invaders can be NULL if there are no invaders.
+ * Tall narrow worlds (think 1000000 x 8) are simulated transposed: otherwise every row costs a kernel
+ * call for a handful of cells, and row bands are awkward to balance.
  */
-int getNextState(const int *currWorld, const int *invaders, int nRows, int nCols, int row, int col, bool *diedDueToFighting)
-{
-    // we'll explicitly set if it was death due to fighting
-    *diedDueToFighting = false;
-
-    // faction of this cell
-    int cellFaction = getValueAt(currWorld, nRows, nCols, row, col);
-
-    // did someone just get landed on?
-    if (invaders != NULL && getValueAt(invaders, nRows, nCols, row, col) != DEAD_FACTION)
-    {
-        *diedDueToFighting = cellFaction != DEAD_FACTION;
-        return getValueAt(invaders, nRows, nCols, row, col);
-    }
+bool shouldTranspose(int nRows, int nCols) {
+    return nCols < TRANSPOSE_BELOW_COLS && nRows >= 2 * nCols;
+}
 
-    // tracks count of each faction adjacent to this cell
-    int neighborCounts[MAX_FACTIONS];
-    memset(neighborCounts, 0, MAX_FACTIONS * sizeof(int));
+box intersectBox(box a, box b) {
+    box i = {
+        a.minRow > b.minRow ? a.minRow : b.minRow,
+        a.maxRow < b.maxRow ? a.maxRow : b.maxRow,
+        a.minCol > b.minCol ? a.minCol : b.minCol,
+        a.maxCol < b.maxCol ? a.maxCol : b.maxCol
+    };
+    return i;
+}
 
-    // count neighbors (and self)
-    for (int dy = -1; dy <= 1; dy++)
-    {
-        for (int dx = -1; dx <= 1; dx++)
-        {
-            int faction = getValueAt(currWorld, nRows, nCols, row + dy, col + dx);
-            if (faction >= DEAD_FACTION)
-            {
-                neighborCounts[faction]++;
+/**
+ * Mirror and rotation symmetries shared by the start world and every invasion plan. The rules treat
+ * all directions alike, so a symmetric world stays symmetric, and only its fundamental region (the
+ * first regionRows rows and regionCols cols) is simulated. The row and col just past the region are
+ * refilled with their mirror images every generation, so kernels see the neighbors they would have
+ * seen in the whole world.
+ */
+typedef struct symmetryStruct {
+    // row r looks like row nRows - 1 - r
+    bool mirrorRows;
+    // col c looks like col nCols - 1 - c
+    bool mirrorCols;
+    // (r, c) looks like (nRows - 1 - r, nCols - 1 - c); only set when neither mirror is
+    bool rotate;
+    int regionRows;
+    int regionCols;
+} symmetry;
+
+bool isSymmetric(const int *grid, int nRows, int nCols, bool flipRows, bool flipCols) {
+    for (int row = 0; row < nRows; row++) {
+        for (int col = 0; col < nCols; col++) {
+            int imageRow = flipRows ? nRows - 1 - row : row;
+            int imageCol = flipCols ? nCols - 1 - col : col;
+            if (getValueAt(grid, nRows, nCols, row, col) != getValueAt(grid, nRows, nCols, imageRow, imageCol)) {
+                return false;
             }
         }
     }
+    return true;
+}
 
-    // we counted this cell as its "neighbor"; adjust for this
-    neighborCounts[cellFaction]--;
+/**
+ * Finds the symmetries of startWorld and invasionPlans (as given to goi), in simulated coordinates.
+ */
+symmetry findSymmetry(const int *startWorld, int nRows, int nCols, int nInvasions, int **invasionPlans, const factionMap *map) {
+    int gridRows = map->transposed ? nCols : nRows;
+    int gridCols = map->transposed ? nRows : nCols;
+    bool flips[3][2] = { { true, false }, { false, true }, { true, true } };
+    bool holds[3];
+    for (int f = 0; f < 3; f++) {
+        holds[f] = isSymmetric(startWorld, gridRows, gridCols, flips[f][0], flips[f][1]);
+        for (int i = 0; i < nInvasions && holds[f]; i++) {
+            holds[f] = isSymmetric(invasionPlans[i], gridRows, gridCols, flips[f][0], flips[f][1]);
+        }
+    }
 
-    if (cellFaction == DEAD_FACTION)
-    {
-        // this is a dead cell; we need to see if a birth is possible:
-        // need exactly 3 of a single faction; we don't care about other factions
+    symmetry sym;
+    sym.mirrorRows = map->transposed ? holds[1] : holds[0];
+    sym.mirrorCols = map->transposed ? holds[0] : holds[1];
+    sym.rotate = holds[2] && !sym.mirrorRows && !sym.mirrorCols;
+    sym.regionRows = sym.mirrorRows || sym.rotate ? (nRows + 1) / 2 : nRows;
+    sym.regionCols = sym.mirrorCols ? (nCols + 1) / 2 : nCols;
+    return sym;
+}
 
-        // by default, no birth
-        int newFaction = DEAD_FACTION;
+bool isReduced(const symmetry *sym) {
+    return sym->mirrorRows || sym->mirrorCols || sym->rotate;
+}
 
-        // start at 1 because we ignore dead neighbors
-        for (int faction = DEAD_FACTION + 1; faction < MAX_FACTIONS; faction++)
-        {
-            int count = neighborCounts[faction];
-            if (isBirthable(count))
-            {
-                newFaction = faction;
+/**
+ * Sets every cell of the padded grid in rect (which lies outside the fundamental region) to the cell
+ * of the region it mirrors.
+ */
+void reflectCells(cell_t *grid, int nRows, int nCols, const symmetry *sym, box rect) {
+    for (int row = rect.minRow; row <= rect.maxRow; row++) {
+        cell_t *cells = paddedRow(grid, nCols, row);
+        for (int col = rect.minCol; col <= rect.maxCol; col++) {
+            int imageRow = row;
+            int imageCol = col;
+            if (row >= sym->regionRows) {
+                imageRow = nRows - 1 - row;
+                if (sym->rotate) {
+                    imageCol = nCols - 1 - col;
+                }
             }
-        }
-
-        return newFaction;
-    }
-    else
-    {
-        /** 
-         * this is a live cell; we follow the usual rules:
-         * Death (fighting): > 0 hostile neighbor
-         * Death (underpopulation): < 2 friendly neighbors and 0 hostile neighbors
-         * Death (overpopulation): > 3 friendly neighbors and 0 hostile neighbors
-         * Survival: 2 or 3 friendly neighbors and 0 hostile neighbors
-         */
-
-        int hostileCount = 0;
-        for (int faction = DEAD_FACTION + 1; faction < MAX_FACTIONS; faction++)
-        {
-            if (faction == cellFaction)
-            {
-                continue;
+            if (sym->mirrorCols && col >= sym->regionCols) {
+                imageCol = nCols - 1 - col;
             }
-            hostileCount += neighborCounts[faction];
-        }
-
-        if (willFight(hostileCount))
-        {
-            *diedDueToFighting = true;
-            return DEAD_FACTION;
+            cells[col] = paddedRow(grid, nCols, imageRow)[imageCol];
         }
+    }
+}
 
-        int friendlyCount = neighborCounts[cellFaction];
-        if (!isSurvivable(friendlyCount))
-        {
-            return DEAD_FACTION;
-        }
+/**
+ * Refills the row and col just past the fundamental region, the only cells outside it that kernels read.
+ */
+void reflectHalo(cell_t *grid, int nRows, int nCols, const symmetry *sym) {
+    int haloRows = sym->regionRows < nRows ? sym->regionRows + 1 : nRows;
+    int haloCols = sym->regionCols < nCols ? sym->regionCols + 1 : nCols;
+    if (sym->regionRows < nRows) {
+        box halo = { sym->regionRows, sym->regionRows, 0, haloCols - 1 };
+        reflectCells(grid, nRows, nCols, sym, halo);
+    }
+    if (sym->regionCols < nCols) {
+        box halo = { 0, haloRows - 1, sym->regionCols, sym->regionCols };
+        reflectCells(grid, nRows, nCols, sym, halo);
+    }
+}
 
-        return cellFaction;
+/**
+ * Rebuilds the whole world from its fundamental region, for printing and export.
+ */
+void reflectWorld(cell_t *grid, int nRows, int nCols, const symmetry *sym) {
+    if (sym->regionRows < nRows) {
+        box below = { sym->regionRows, nRows - 1, 0, nCols - 1 };
+        reflectCells(grid, nRows, nCols, sym, below);
+    }
+    if (sym->regionCols < nCols) {
+        box right = { 0, sym->regionRows - 1, sym->regionCols, nCols - 1 };
+        reflectCells(grid, nRows, nCols, sym, right);
     }
 }
 
-int getRow(int nRows, int nCols, int index) {
-    return index / nCols;
+/**
+ * Returns the box covering b and its mirror images. A live cell in the region also stands for its
+ * images, whose neighbors may lie in the region too (far from b when rotating).
+ */
+box symmetricBox(box b, int nRows, int nCols, const symmetry *sym) {
+    if (isEmptyBox(b)) return b;
+    box flippedRows = { nRows - 1 - b.maxRow, nRows - 1 - b.minRow, b.minCol, b.maxCol };
+    box flippedCols = { b.minRow, b.maxRow, nCols - 1 - b.maxCol, nCols - 1 - b.minCol };
+    box rotated = { flippedRows.minRow, flippedRows.maxRow, flippedCols.minCol, flippedCols.maxCol };
+    if (sym->mirrorRows) b = unionBox(b, flippedRows);
+    if (sym->mirrorCols) b = unionBox(b, flippedCols);
+    if (sym->rotate || (sym->mirrorRows && sym->mirrorCols)) b = unionBox(b, rotated);
+    return b;
+}
+
+/**
+ * The number of cells of the whole world that cell (row, col) of the fundamental region stands for
+ * is rowWeight * colWeight: cells on a mirror axis (the middle row or col of an odd dimension) only
+ * stand for themselves along it.
+ */
+int rowWeight(const symmetry *sym, int nRows, int row) {
+    if (!sym->mirrorRows && !sym->rotate) return 1;
+    return nRows % 2 == 1 && row == sym->regionRows - 1 ? 1 : 2;
 }
 
-int getCol(int nRows, int nCols, int index) {
-    return index % nCols;
+// the col on the mirror axis, or -1 if there is none
+int axisCol(const symmetry *sym, int nCols) {
+    return sym->mirrorCols && nCols % 2 == 1 ? sym->regionCols - 1 : -1;
 }
 
+#if IN_PLACE_UPDATE
+#define ROW_BUFFERS 5
+#else
+#define ROW_BUFFERS 1
+#endif
+
 typedef struct sharedStruct {
-    pthread_mutex_t* mutex;
-    int* world;
-    int* inv;
+    // padded grids (see kernel.h)
+    cell_t* world;
+    // the plan landing this generation, or NULL; each row is packed into invRow as it is swept
+    const int* plan;
+    cell_t* invRow;
+    const factionMap* map;
+    const symmetry* sym;
+    rowKernel kernel;
+#if MEMO_ROWS
+    memoTable* memo;
+#endif
+    cell_t* rowBuffers;
     int nRows;
     int nCols;
-    int startIdx;
-    int endIdx;
-    int* wholeNewWorld;
-    int* deathToll;
+    // the rectangle this thread sweeps this generation, rows and cols are half-open
+    int startRow;
+    int endRow;
+    int startCol;
+    int endCol;
+    cell_t* wholeNewWorld;
+#if IN_PLACE_UPDATE
+    // copies of the original rows just above and below this thread's band, made by goi
+    cell_t* haloAbove;
+    cell_t* haloBelow;
+    // the last two original rows of the band, before they were overwritten
+    cell_t* rowCopies[2];
+#endif
     int iteration;
     int tid;
     pthread_mutex_t* isReady;
     int totalIteration;
-    pthread_barrier_t* barrier;
+    // adds up the deaths and live boxes of the threads at the end of each generation
+    treeBarrier* barrier;
 } shared;
 
+/**
+ * Splits the rows of region into nThreads contiguous bands, one per thread. If region has fewer rows
+ * than there are threads, each row is split into column chunks instead (unless updating in place,
+ * where a row must belong to a single thread). Threads whose band is empty sweep nothing.
+ */
+void partitionRegion(shared** sharedStructs, int nThreads, box region) {
+    int nRegionRows = isEmptyBox(region) ? 0 : region.maxRow - region.minRow + 1;
+    int nRegionCols = isEmptyBox(region) ? 0 : region.maxCol - region.minCol + 1;
+    int rowBands = nThreads;
+    int colBands = 1;
+#if !IN_PLACE_UPDATE
+    if (nRegionRows > 0 && nRegionRows < nThreads) {
+        rowBands = nRegionRows;
+        colBands = nThreads / nRegionRows;
+    }
+#endif
+    for (int t = 0; t < nThreads; t++) {
+        shared* item = sharedStructs[t];
+        int band = t / colBands;
+        int chunk = t % colBands;
+        if (band >= rowBands) {
+            item->startRow = item->endRow = region.minRow;
+            continue;
+        }
+        item->startRow = region.minRow + (int)((long)nRegionRows * band / rowBands);
+        item->endRow = region.minRow + (int)((long)nRegionRows * (band + 1) / rowBands);
+        item->startCol = region.minCol + (int)((long)nRegionCols * chunk / colBands);
+        item->endCol = region.minCol + (int)((long)nRegionCols * (chunk + 1) / colBands);
+    }
+}
+
+#if IN_PLACE_UPDATE
+/**
+ * Copies cells [startCol - 1, endCol] of the padded row src, the ones a kernel reads to compute
+ * [startCol, endCol), into dst.
+ */
+void copyRowRange(cell_t* dst, const cell_t* src, int startCol, int endCol) {
+    memcpy(dst + startCol - 1, src + startCol - 1, (endCol - startCol + 2) * sizeof(cell_t));
+}
+#endif
+
+/**
+ * Runs this thread's row kernel, through the memo table if there is one.
+ */
+int runKernel(shared* sharedVariables, const cell_t* above, const cell_t* row, const cell_t* below,
+    const cell_t* invaders, cell_t* newRow, int startCol, int endCol, int* firstLive, int* lastLive) {
+#if MEMO_ROWS
+    return stepRowMemo(sharedVariables->memo, sharedVariables->kernel, above, row, below, invaders,
+        newRow, startCol, endCol, firstLive, lastLive);
+#else
+    return sharedVariables->kernel(above, row, below, invaders, newRow, startCol, endCol, firstLive, lastLive);
+#endif
+}
+
+/**
+ * Steps cells [startCol, endCol) of row rowIndex, and returns the deaths they stand for in the whole
+ * world (see rowWeight).
+ */
+int stepRow(shared* sharedVariables, int rowIndex, const cell_t* above, const cell_t* row, const cell_t* below,
+    const cell_t* invaders, cell_t* newRow, int startCol, int endCol, int* firstLive, int* lastLive) {
+    const symmetry* sym = sharedVariables->sym;
+    if (!isReduced(sym)) {
+        return runKernel(sharedVariables, above, row, below, invaders, newRow, startCol, endCol, firstLive, lastLive);
+    }
+
+    // the axis col is always the last col of the region, so it can only end a range
+    int axis = axisCol(sym, sharedVariables->nCols);
+    int mirroredEnd = axis >= startCol && axis < endCol ? axis : endCol;
+    int deaths = runKernel(sharedVariables, above, row, below, invaders, newRow, startCol, mirroredEnd, firstLive, lastLive);
+    if (sym->mirrorCols) {
+        deaths *= 2;
+    }
+    if (mirroredEnd < endCol) {
+        deaths += runKernel(sharedVariables, above, row, below, invaders, newRow, mirroredEnd, endCol, firstLive, lastLive);
+    }
+    return deaths * rowWeight(sym, sharedVariables->nRows, rowIndex);
+}
+
 void* subroutine(void* sharedStruct) {
     shared* sharedVariables = (shared*) sharedStruct;
+    int nRows = sharedVariables->nRows;
+    int nCols = sharedVariables->nCols;
     
     for (int k = 1; k <= sharedVariables->totalIteration; k++) {
         pthread_mutex_lock(&(sharedVariables->isReady[sharedVariables->tid]));
-        for (int i = sharedVariables->startIdx; i < sharedVariables->endIdx; i++) {
-            bool diedDueToFighting = false;
-            int row = getRow(sharedVariables->nRows, sharedVariables->nCols, i);
-            int col = getCol(sharedVariables->nRows, sharedVariables->nCols, i);
-            int nextState = getNextState(sharedVariables->world, 
-                sharedVariables->inv, sharedVariables->nRows, sharedVariables->nCols, row, col, &diedDueToFighting);
-
-            setValueAt(sharedVariables->wholeNewWorld, sharedVariables->nRows, sharedVariables->nCols, row, col, nextState);
-
-            if (diedDueToFighting)
-            {   
-                // to check for where is the death toll
-                pthread_mutex_lock(sharedVariables->mutex);
-                //need synchronisation here
-                (*(sharedVariables->deathToll))++;
-                pthread_mutex_unlock(sharedVariables->mutex);
+        int startCol = sharedVariables->startCol;
+        int endCol = sharedVariables->endCol;
+        box liveBox = emptyBox(nRows, nCols);
+        long long deaths = 0;
+#if IN_PLACE_UPDATE
+        const cell_t* above = sharedVariables->haloAbove;
+#endif
+        for (int row = sharedVariables->startRow; row < sharedVariables->endRow; row++) {
+            const cell_t* invaders = NULL;
+            if (sharedVariables->plan != NULL)
+            {
+                packRow(sharedVariables->plan, nRows, nCols, row, startCol, endCol, sharedVariables->invRow, sharedVariables->map);
+                invaders = sharedVariables->invRow;
+            }
+
+            int firstLive = nCols;
+            int lastLive = -1;
+#if IN_PLACE_UPDATE
+            // keep the original row, since the kernel overwrites it and the next row still needs it
+            cell_t* original = sharedVariables->rowCopies[row % 2];
+            copyRowRange(original, paddedRow(sharedVariables->world, nCols, row), startCol, endCol);
+            const cell_t* below = row + 1 < sharedVariables->endRow
+                ? paddedRow(sharedVariables->world, nCols, row + 1)
+                : sharedVariables->haloBelow;
+            deaths += stepRow(sharedVariables, row, above, original, below, invaders,
+                paddedRow(sharedVariables->world, nCols, row), startCol, endCol, &firstLive, &lastLive);
+            above = original;
+#else
+            deaths += stepRow(sharedVariables, row,
+                paddedRow(sharedVariables->world, nCols, row - 1),
+                paddedRow(sharedVariables->world, nCols, row),
+                paddedRow(sharedVariables->world, nCols, row + 1),
+                invaders,
+                paddedRow(sharedVariables->wholeNewWorld, nCols, row),
+                startCol, endCol, &firstLive, &lastLive);
+#endif
+
+            if (lastLive >= 0)
+            {
+                addToBox(&liveBox, row, firstLive);
+                addToBox(&liveBox, row, lastLive);
             }
         }
-        pthread_barrier_wait(sharedVariables->barrier);
+
+        generationTotals mine = { deaths, liveBox };
+        treeBarrierWait(sharedVariables->barrier, sharedVariables->tid, mine);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the bytes of arena (see alloc.c) that goi allocates for a world of nRows x nCols simulated
+ * with nThreads, or 0 if it hands the world to another engine, which allocates on its own.
+ */
+size_t goiArenaSize(int nThreads, int nRows, int nCols)
+{
+    if (fitsTinyEngine(nRows, nCols) || HASHSET_ENGINE || TILED_LAYOUT || ATTRIBUTE_DEATHS)
+    {
+        return 0;
     }
+
+    // nCols may be swapped with nRows (see shouldTranspose)
+    int maxCols = nRows > nCols ? nRows : nCols;
+    size_t gridBytes = arenaBytes((size_t) (nRows + 2) * (nCols + 2) * sizeof(cell_t));
+    size_t size = IN_PLACE_UPDATE ? gridBytes : 2 * gridBytes;
+    size += arenaBytes(sizeof(pthread_t) * nThreads)
+        + arenaBytes(sizeof(pthread_mutex_t) * nThreads)
+        + arenaBytes(sizeof(shared*) * nThreads)
+        + arenaBytes(treeBarrierSize(nThreads + 1))
+        + nThreads * (arenaBytes(sizeof(shared)) + arenaBytes((size_t) ROW_BUFFERS * (maxCols + 2) * sizeof(cell_t)));
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    size += arenaBytes(sizeof(int) * nRows * nCols);
+#endif
+#if MEMO_ROWS
+    size += arenaBytes(memoTableSize());
+#endif
+    return size;
 }
 
 /**
@@ -194,140 +473,209 @@ void* subroutine(void* sharedStruct) {
  * 
  * goi does not own startWorld, invasionTimes or invasionPlans and should not modify or attempt to free them.
  * nThreads is the number of threads to simulate with. It is ignored by the sequential implementation.
+ *
+ * With ATTRIBUTE_DEATHS set, every world is handed to goiTiled, which tags its tiles with invasions.
+ * Otherwise worlds that fit the tiny engine are handed to goiTiny instead. With HASHSET_ENGINE set, all
+ * others go to goiHashSet, and otherwise with TILED_LAYOUT set, to goiTiled.
+ *
+ * Each generation only the bounding box of the live cells grown by one cell is swept, together with
+ * the footprint of the invasion landing that generation (if any). Everything outside of it stays dead.
+ *
+ * Factions are renumbered densely up front, so that the row kernel only considers the factions that
+ * appear in startWorld or invasionPlans. Tall narrow worlds are simulated transposed, and worlds that
+ * are mirror or rotation symmetric (invasion plans included) only simulate their fundamental region.
  */
-pthread_barrier_t barrier;
-
-int goi(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans)
+long long goi(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans)
 {
-    // death toll due to fighting
-    int deathToll = 0;
+#if ATTRIBUTE_DEATHS
+    return goiTiled(nThreads, nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+#endif
 
-    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-    
-    pthread_t threads[nThreads];
-    long threadsId[nThreads];
-    pthread_mutex_t isReady[nThreads];
-    pthread_barrier_init(&barrier, NULL, nThreads + 1);
-    shared** sharedStructs = malloc(sizeof(shared) * nThreads); // need to clean
-    if (sharedStructs == NULL) {
+    // tiny worlds are cheaper to step on this thread than to spread over workers
+    if (fitsTinyEngine(nRows, nCols))
+    {
+        return goiTiny(nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+    }
+
+#if HASHSET_ENGINE
+    return goiHashSet(nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+#endif
+
+#if TILED_LAYOUT
+    return goiTiled(nThreads, nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+#endif
+
+    // death toll due to fighting
+    long long deathToll = 0;
+
+    pthread_t* threads = allocBuffer(sizeof(pthread_t) * nThreads);
+    pthread_mutex_t* isReady = allocBuffer(sizeof(pthread_mutex_t) * nThreads);
+    // the workers are participants 0 to nThreads - 1, this thread is participant nThreads
+    treeBarrier* barrier = createTreeBarrier(nThreads + 1);
+    shared** sharedStructs = allocBuffer(sizeof(shared*) * nThreads); // need to clean
+    if (threads == NULL || isReady == NULL || barrier == NULL || sharedStructs == NULL) {
         printf("ERROR\n");
         exit(-1);
     }
-    int totalGrids = nRows * nCols;
-    int threadSize = totalGrids / nThreads;
-    int index = 0;
+
+    factionMap map;
+    buildFactionMap(&map, startWorld, nRows, nCols, nInvasions, invasionPlans);
+    rowKernel kernel = selectRowKernel(map.nFactions);
+
+    // from here on nRows and nCols are those of the simulated world; printing and export still see
+    // the world as given
+    int printRows = nRows;
+    int printCols = nCols;
+    map.transposed = shouldTranspose(nRows, nCols);
+    if (map.transposed)
+    {
+        nRows = printCols;
+        nCols = printRows;
+    }
 
     // init the world!
     // we make a copy because we do not own startWorld (and will perform free() on world)
-    int *world = malloc(sizeof(int) * nRows * nCols);
+    cell_t *world = allocPaddedGrid(nRows, nCols);
     if (world == NULL)
     {
         return -1;
     }
-    for (int row = 0; row < nRows; row++)
+    packGrid(startWorld, world, nRows, nCols, &map);
+    box liveBox = findLiveBox(world, nRows, nCols);
+
+    // symmetric scenarios only sweep their fundamental region, everything past it is a mirror image
+    symmetry sym = findSymmetry(startWorld, nRows, nCols, nInvasions, invasionPlans, &map);
+    box fundamental = { 0, sym.regionRows - 1, 0, sym.regionCols - 1 };
+
+#if IN_PLACE_UPDATE
+    // the world is updated in place, so there is nothing stale to overwrite
+    cell_t *wholeNewWorld = NULL;
+#else
+    // the next world state is written into a second buffer that is swapped with world every
+    // generation; it starts out all dead, and staleBox bounds whatever it holds afterwards
+    cell_t *wholeNewWorld = allocPaddedGrid(nRows, nCols);
+    if (wholeNewWorld == NULL)
     {
-        for (int col = 0; col < nCols; col++)
-        {
-            setValueAt(world, nRows, nCols, row, col, getValueAt(startWorld, nRows, nCols, row, col));
-        }
+        freePaddedGrid(world);
+        return -1;
+    }
+#endif
+    box staleBox = emptyBox(nRows, nCols);
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    // worlds are printed and exported with their original factions
+    int *grid = allocBuffer(sizeof(int) * nRows * nCols);
+    if (grid == NULL)
+    {
+        freePaddedGrid(world);
+        freePaddedGrid(wholeNewWorld);
+        return -1;
+    }
+#endif
+
+#if MEMO_ROWS
+    memoTable *memo = createMemoTable();
+    if (memo == NULL)
+    {
+        freePaddedGrid(world);
+        freePaddedGrid(wholeNewWorld);
+        return -1;
     }
+#endif
 
-    // initialize the structs, startIdx and endIdx here
-    for (int i = 0; i < nThreads - 1; i++) {
-        shared* item = malloc(sizeof(shared));
+    // initialize the structs here; the rows and cols they sweep are set every generation
+    for (int i = 0; i < nThreads; i++) {
+        shared* item = allocBuffer(sizeof(shared));
+        if (item == NULL) {
+            printf("ERROR\n");
+            exit(-1);
+        }
         item->world = world;
-        item->mutex = &mutex;
+        item->map = &map;
+        item->sym = &sym;
+        item->kernel = kernel;
+#if MEMO_ROWS
+        item->memo = memo;
+#endif
+        // padded rows: the invasion row, then (in place) the two halos and two row copies
+        item->rowBuffers = allocBuffer((size_t) ROW_BUFFERS * (nCols + 2) * sizeof(cell_t));
+        if (item->rowBuffers == NULL) {
+            printf("ERROR\n");
+            exit(-1);
+        }
+        item->invRow = item->rowBuffers + 1;
+#if IN_PLACE_UPDATE
+        item->haloAbove = item->invRow + (nCols + 2);
+        item->haloBelow = item->haloAbove + (nCols + 2);
+        item->rowCopies[0] = item->haloBelow + (nCols + 2);
+        item->rowCopies[1] = item->rowCopies[0] + (nCols + 2);
+#endif
         item->nRows = nRows;
         item->nCols = nCols;
-        item->deathToll = &deathToll;
         item->tid = i;
-        item->startIdx = index;
-        item->endIdx = fmin(index + threadSize, totalGrids);
         item->isReady = isReady;
         pthread_mutex_init(&(isReady[i]), NULL);
-        index = index + threadSize;
         sharedStructs[i] = item;
-        threadsId[i] = i;
         item->totalIteration = nGenerations;
-        item->barrier = &barrier;
-        printf("creating thread %d with startIndex: %i and endIdx: %i\n", i, item->startIdx, item->endIdx);
+        item->barrier = barrier;
     }
 
-    // the nThreads - 1 thread
-    shared* lastItem = malloc(sizeof(shared));
-    lastItem->world = world;
-    lastItem->mutex = &mutex;
-    lastItem->isReady = isReady;
-    pthread_mutex_init(&(isReady[nThreads - 1]), NULL);
-    lastItem->nRows = nRows;
-    lastItem->nCols = nCols;
-    lastItem->deathToll = &deathToll;
-    lastItem->tid = nThreads - 1;
-    lastItem->startIdx = index;
-    lastItem->endIdx = totalGrids;
-    lastItem->totalIteration = nGenerations;
-    lastItem->barrier = &barrier;
-    sharedStructs[nThreads - 1] = lastItem;
-    threadsId[nThreads - 1] = nThreads - 1;
-    printf("creating thread %d with startIndex: %i and endIdx: %i\n", nThreads - 1, lastItem->startIdx, lastItem->endIdx);
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    unpackGrid(world, grid, nRows, nCols, &map);
+#endif
 
 #if PRINT_GENERATIONS
     printf("\n=== WORLD 0 ===\n");
-    printWorld(world, nRows, nCols);
+    printWorld(grid, printRows, printCols);
 #endif
 
 #if EXPORT_GENERATIONS
-    exportWorld(world, nRows, nCols);
+    exportGeneration(grid, printRows, printCols);
 #endif
     bool spawnThreads = false;
     // Begin simulating
     int invasionIndex = 0;
     for (int i = 1; i <= nGenerations; i++)
     {
+        // cells that can come alive this generation, and cells of wholeNewWorld that must be overwritten
+        box region = unionBox(growBox(symmetricBox(liveBox, nRows, nCols, &sym), nRows, nCols), staleBox);
+
         // is there an invasion this generation?
-        int *inv = NULL;
+        const int *plan = NULL;
         if (invasionIndex < nInvasions && i == invasionTimes[invasionIndex])
         {
-            // we make a copy because we do not own invasionPlans
-            inv = malloc(sizeof(int) * nRows * nCols);
-            if (inv == NULL)
-            {
-                free(world);
-                return -1;
-            }
-            for (int row = 0; row < nRows; row++)
-            {
-                for (int col = 0; col < nCols; col++)
-                {
-                    setValueAt(inv, nRows, nCols, row, col, getValueAt(invasionPlans[invasionIndex], nRows, nCols, row, col));
-                }
-            }
+            plan = invasionPlans[invasionIndex];
+            region = unionBox(region, findPlanBox(plan, nRows, nCols, &map));
             invasionIndex++;
         }
+        region = intersectBox(region, fundamental);
 
         // create the next world state
+        partitionRegion(sharedStructs, nThreads, region);
 
-        int *wholeNewWorld = malloc(sizeof(int) * nRows * nCols);
-        if (wholeNewWorld == NULL)
-        {
-            if (inv != NULL)
-            {
-                free(inv);
+#if IN_PLACE_UPDATE
+        // the rows just outside each band are overwritten by the neighboring bands, so save them
+        // before any thread starts
+        for (int t = 0; t < nThreads; t++) {
+            shared* item = sharedStructs[t];
+            if (item->startRow < item->endRow) {
+                copyRowRange(item->haloAbove, paddedRow(world, nCols, item->startRow - 1), item->startCol, item->endCol);
+                copyRowRange(item->haloBelow, paddedRow(world, nCols, item->endRow), item->startCol, item->endCol);
             }
-            free(world);
-            return -1;
         }
+#endif
 
         int rc;
         for (int t = 0; t < nThreads; t++) {
             // get the struct
             shared* item = sharedStructs[t];
             item->world = world;
-            item->inv = inv;
+            item->plan = plan;
             item->wholeNewWorld = wholeNewWorld;
             item->iteration = i;
             pthread_mutex_unlock(&(item->isReady[t]));
             if (!spawnThreads) {
+                printf("creating thread %d with startRow: %i and endRow: %i\n", t, item->startRow, item->endRow);
                 rc = pthread_create(&threads[t], NULL, &subroutine,
                     (void*)item);
                 
@@ -337,46 +685,76 @@ int goi(int nThreads, int nGenerations, const int *startWorld, int nRows, int nC
                 }
             }
         }
-            
-        
-        spawnThreads = true;
-        pthread_barrier_wait(&barrier);
 
-        if (inv != NULL)
-        {
-            free(inv);
+#if PIN_THREADS
+        if (!spawnThreads) {
+            placeThreads(threads, nThreads);
         }
+#endif
+        spawnThreads = true;
+        generationTotals none = { 0, emptyBox(nRows, nCols) };
+        generationTotals totals = treeBarrierWait(barrier, nThreads, none);
+        deathToll += totals.deaths;
+#if STREAM_DEATHS
+        recordDeaths(i, totals.deaths);
+#endif
 
-        // swap worlds
-        
-        free(world);
+#if !IN_PLACE_UPDATE
+        // swap worlds; the old world becomes the buffer overwritten next generation
+        staleBox = liveBox;
+        cell_t *oldWorld = world;
         world = wholeNewWorld;
+        wholeNewWorld = oldWorld;
+#endif
+
+        liveBox = totals.liveBox;
+        if (isReduced(&sym)) {
+            reflectHalo(world, nRows, nCols, &sym);
+        }
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        if (isReduced(&sym)) {
+            reflectWorld(world, nRows, nCols, &sym);
+        }
+        unpackGrid(world, grid, nRows, nCols, &map);
+#endif
 
 #if PRINT_GENERATIONS
         printf("\n=== WORLD %d ===\n", i);
-        printWorld(world, nRows, nCols);
+        printWorld(grid, printRows, printCols);
 #endif
 
 #if EXPORT_GENERATIONS
-        exportWorld(world, nRows, nCols);
+        exportGeneration(grid, printRows, printCols);
 #endif
     }
 
-    for (int i = 0; i < nThreads; i++) {
+    for (int i = 0; i < nThreads && spawnThreads; i++) {
         pthread_join(threads[i], NULL);
     }
 
-    free(world);
+    freePaddedGrid(world);
+    freePaddedGrid(wholeNewWorld);
+#if MEMO_ROWS
+    freeMemoTable(memo);
+#endif
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    freeBuffer(grid);
+#endif
 
     /* clean up the structs*/
     for (int i = 0; i < nThreads; i++) {
         shared* item = sharedStructs[i];
         // free the mutex
-        pthread_mutex_destroy(item->mutex);
-        free(item);
+        pthread_mutex_destroy(&(item->isReady[i]));
+        freeBuffer(item->rowBuffers);
+        freeBuffer(item);
     }
+    freeTreeBarrier(barrier);
     
-    free(sharedStructs);
+    freeBuffer(sharedStructs);
+    freeBuffer(isReady);
+    freeBuffer(threads);
 
     return deathToll;
 }
@@ -1,6 +1,37 @@
 #ifndef GOI_H
 #define GOI_H
 
-int goi(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans);
+#include <stddef.h>
+#include <stdint.h>
+#include "settings.h"
+
+// cells hold faction ids; MAX_FACTIONS includes the "dead faction": 0
+#if WIDE_CELLS
+typedef uint16_t cell_t;
+#define MAX_FACTIONS 65536
+#else
+typedef uint8_t cell_t;
+#define MAX_FACTIONS 256
+#endif
+
+// this macro is here to make the code slightly more readable, not because it can be safely changed to
+// any integer value; changing this to a non-zero value may break the code
+#define DEAD_FACTION 0
+
+/**
+ * Bounding box of the live cells of a world, inclusive on both ends. An empty box has
+ * minRow > maxRow (and minCol > maxCol).
+ */
+typedef struct boxStruct {
+    int minRow;
+    int maxRow;
+    int minCol;
+    int maxCol;
+} box;
+
+box unionBox(box a, box b);
+
+size_t goiArenaSize(int nThreads, int nRows, int nCols);
+long long goi(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans);
 
 #endif
@@ -0,0 +1,394 @@
+/**
+ * Single-threaded engine for nearly empty worlds, enabled by HASHSET_ENGINE.
+ *
+ * Only live cells are stored, in an open-addressed hash table keyed by their coordinates. Each generation
+ * the cells that can change (live cells, their neighbors and the cells an invasion lands on) are gathered
+ * into a second table, and each of them is stepped on its own. Apart from reading the grids handed over
+ * by main.c, time and memory scale with the number of live cells rather than with nRows * nCols.
+ *
+ * Cells are stepped with the row kernel of the dense engines, on a 3 x 3 neighborhood, so the rules stay
+ * in kernel.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "util.h"
+#include "frames.h"
+#include "settings.h"
+#include "goi.h"
+#include "hashset.h"
+#include "kernel.h"
+#include "deathstream.h"
+
+// a row in the high 32 bits and a col in the low 32 bits
+typedef uint64_t cellKey;
+
+// no cell has this key, rows and cols being below 2^31
+#define EMPTY_KEY UINT64_MAX
+
+// smallest table, in slots; tables are at most half full
+#define MIN_CAPACITY 64
+
+typedef struct cellSetStruct {
+    cellKey *keys;
+    cell_t *cells;
+    // number of slots, a power of 2
+    size_t capacity;
+    size_t count;
+} cellSet;
+
+static cellKey keyOf(int row, int col)
+{
+    return (cellKey) (uint32_t) row << 32 | (uint32_t) col;
+}
+
+static int rowOf(cellKey key)
+{
+    return (int) (key >> 32);
+}
+
+static int colOf(cellKey key)
+{
+    return (int) (uint32_t) key;
+}
+
+static size_t slotOf(const cellSet *set, cellKey key)
+{
+    return (size_t) ((key * 0x9e3779b97f4a7c15ull) >> 17) & (set->capacity - 1);
+}
+
+static bool initCellSet(cellSet *set, size_t capacity)
+{
+    set->keys = malloc(capacity * sizeof(cellKey));
+    set->cells = malloc(capacity * sizeof(cell_t));
+    if (set->keys == NULL || set->cells == NULL)
+    {
+        free(set->keys);
+        free(set->cells);
+        set->keys = NULL;
+        set->cells = NULL;
+        return false;
+    }
+    set->capacity = capacity;
+    set->count = 0;
+    memset(set->keys, 0xff, capacity * sizeof(cellKey));
+    return true;
+}
+
+static void freeCellSet(cellSet *set)
+{
+    free(set->keys);
+    free(set->cells);
+}
+
+static void clearCellSet(cellSet *set)
+{
+    set->count = 0;
+    memset(set->keys, 0xff, set->capacity * sizeof(cellKey));
+}
+
+/**
+ * Returns the cell stored under key, or DEAD_FACTION if there is none.
+ */
+static cell_t lookupCell(const cellSet *set, cellKey key)
+{
+    for (size_t slot = slotOf(set, key); ; slot = (slot + 1) & (set->capacity - 1))
+    {
+        if (set->keys[slot] == key)
+        {
+            return set->cells[slot];
+        }
+        if (set->keys[slot] == EMPTY_KEY)
+        {
+            return DEAD_FACTION;
+        }
+    }
+}
+
+static bool insertCell(cellSet *set, cellKey key, cell_t cell);
+
+/**
+ * Doubles the capacity of set. Returns false if out of memory, leaving set as it was.
+ */
+static bool growCellSet(cellSet *set)
+{
+    cellSet grown;
+    if (!initCellSet(&grown, set->capacity * 2))
+    {
+        return false;
+    }
+    for (size_t slot = 0; slot < set->capacity; slot++)
+    {
+        if (set->keys[slot] != EMPTY_KEY)
+        {
+            insertCell(&grown, set->keys[slot], set->cells[slot]);
+        }
+    }
+    freeCellSet(set);
+    *set = grown;
+    return true;
+}
+
+/**
+ * Stores cell under key, unless key is already there. Returns false if out of memory.
+ */
+static bool insertCell(cellSet *set, cellKey key, cell_t cell)
+{
+    if (2 * (set->count + 1) > set->capacity && !growCellSet(set))
+    {
+        return false;
+    }
+    size_t slot = slotOf(set, key);
+    while (set->keys[slot] != EMPTY_KEY)
+    {
+        if (set->keys[slot] == key)
+        {
+            return true;
+        }
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->keys[slot] = key;
+    set->cells[slot] = cell;
+    set->count++;
+    return true;
+}
+
+/**
+ * Stores the live cells of grid (as given to goi) into the (empty) set, as dense faction ids.
+ */
+static bool loadCellSet(cellSet *set, const int *grid, int nRows, int nCols, const factionMap *map)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        for (int col = 0; col < nCols; col++)
+        {
+            int faction = getValueAt(grid, nRows, nCols, row, col);
+            if (faction > DEAD_FACTION && faction < MAX_FACTIONS
+                && !insertCell(set, keyOf(row, col), map->toDense[faction]))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+static void storeCellSet(const cellSet *set, int *grid, int nRows, int nCols, const factionMap *map)
+{
+    memset(grid, 0, sizeof(int) * nRows * nCols);
+    for (size_t slot = 0; slot < set->capacity; slot++)
+    {
+        if (set->keys[slot] != EMPTY_KEY)
+        {
+            grid[(size_t) rowOf(set->keys[slot]) * nCols + colOf(set->keys[slot])] = map->toFaction[set->cells[slot]];
+        }
+    }
+}
+#endif
+
+/**
+ * Adds the cells of world that can change next generation to candidates.
+ */
+static bool gatherCandidates(const cellSet *world, const cellSet *inv, cellSet *candidates, int nRows, int nCols)
+{
+    for (size_t slot = 0; slot < world->capacity; slot++)
+    {
+        if (world->keys[slot] == EMPTY_KEY)
+        {
+            continue;
+        }
+        int row = rowOf(world->keys[slot]);
+        int col = colOf(world->keys[slot]);
+        for (int r = row - 1; r <= row + 1; r++)
+        {
+            for (int c = col - 1; c <= col + 1; c++)
+            {
+                if (r >= 0 && r < nRows && c >= 0 && c < nCols && !insertCell(candidates, keyOf(r, c), DEAD_FACTION))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    for (size_t slot = 0; inv != NULL && slot < inv->capacity; slot++)
+    {
+        if (inv->keys[slot] != EMPTY_KEY && !insertCell(candidates, inv->keys[slot], DEAD_FACTION))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Computes the next state of world into the (empty) newWorld, with inv (can be NULL) landing. Returns
+ * the number of deaths due to fighting, or -1 if out of memory.
+ */
+static long long stepHashSet(const cellSet *world, const cellSet *inv, cellSet *candidates, cellSet *newWorld,
+    rowKernel kernel, int nRows, int nCols)
+{
+    clearCellSet(candidates);
+    if (!gatherCandidates(world, inv, candidates, nRows, nCols))
+    {
+        return -1;
+    }
+
+    long long deaths = 0;
+    for (size_t slot = 0; slot < candidates->capacity; slot++)
+    {
+        if (candidates->keys[slot] == EMPTY_KEY)
+        {
+            continue;
+        }
+        int row = rowOf(candidates->keys[slot]);
+        int col = colOf(candidates->keys[slot]);
+
+        // the neighborhood as three padded rows of one cell; cells past the edges are dead
+        cell_t neighborhood[3][3];
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int nRow = row + r - 1;
+                int nCol = col + c - 1;
+                bool inWorld = nRow >= 0 && nRow < nRows && nCol >= 0 && nCol < nCols;
+                neighborhood[r][c] = inWorld ? lookupCell(world, keyOf(nRow, nCol)) : DEAD_FACTION;
+            }
+        }
+        cell_t invaders[3] = { DEAD_FACTION, DEAD_FACTION, DEAD_FACTION };
+        if (inv != NULL)
+        {
+            invaders[1] = lookupCell(inv, candidates->keys[slot]);
+        }
+
+        cell_t next[3];
+        int firstLive = 1;
+        int lastLive = -1;
+        deaths += kernel(neighborhood[0] + 1, neighborhood[1] + 1, neighborhood[2] + 1,
+            inv != NULL ? invaders + 1 : NULL, next + 1, 0, 1, &firstLive, &lastLive);
+        if (next[1] != DEAD_FACTION && !insertCell(newWorld, candidates->keys[slot], next[1]))
+        {
+            return -1;
+        }
+    }
+    return deaths;
+}
+
+static void freeCellSets(cellSet *sets, int nSets)
+{
+    for (int s = 0; s < nSets; s++)
+    {
+        freeCellSet(&sets[s]);
+    }
+    free(sets);
+}
+
+long long goiHashSet(int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans)
+{
+    // death toll due to fighting
+    long long deathToll = 0;
+
+    factionMap map;
+    buildFactionMap(&map, startWorld, nRows, nCols, nInvasions, invasionPlans);
+    rowKernel kernel = selectRowKernel(map.nFactions);
+
+    // the world, the next world, the candidates, then the live cells of each invasion plan
+    int nSets = nInvasions + 3;
+    cellSet *sets = calloc((size_t) nSets, sizeof(cellSet));
+    if (sets == NULL)
+    {
+        return -1;
+    }
+    cellSet *world = sets;
+    cellSet *newWorld = sets + 1;
+    cellSet *candidates = sets + 2;
+    cellSet *invasions = sets + 3;
+    for (int s = 0; s < nSets; s++)
+    {
+        if (!initCellSet(&sets[s], MIN_CAPACITY))
+        {
+            freeCellSets(sets, nSets);
+            return -1;
+        }
+    }
+    bool loaded = loadCellSet(world, startWorld, nRows, nCols, &map);
+    for (int i = 0; i < nInvasions && loaded; i++)
+    {
+        loaded = loadCellSet(&invasions[i], invasionPlans[i], nRows, nCols, &map);
+    }
+    if (!loaded)
+    {
+        freeCellSets(sets, nSets);
+        return -1;
+    }
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    int *grid = malloc(sizeof(int) * nRows * nCols);
+    if (grid == NULL)
+    {
+        freeCellSets(sets, nSets);
+        return -1;
+    }
+    storeCellSet(world, grid, nRows, nCols, &map);
+#endif
+
+#if PRINT_GENERATIONS
+    printf("\n=== WORLD 0 ===\n");
+    printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+    exportGeneration(grid, nRows, nCols);
+#endif
+
+    int invasionIndex = 0;
+    for (int i = 1; i <= nGenerations; i++)
+    {
+        // is there an invasion this generation?
+        const cellSet *inv = NULL;
+        if (invasionIndex < nInvasions && i == invasionTimes[invasionIndex])
+        {
+            inv = &invasions[invasionIndex];
+            invasionIndex++;
+        }
+
+        clearCellSet(newWorld);
+        long long deaths = stepHashSet(world, inv, candidates, newWorld, kernel, nRows, nCols);
+        if (deaths < 0)
+        {
+            deathToll = -1;
+            break;
+        }
+        deathToll += deaths;
+#if STREAM_DEATHS
+        recordDeaths(i, deaths);
+#endif
+
+        cellSet *tmp = world;
+        world = newWorld;
+        newWorld = tmp;
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        storeCellSet(world, grid, nRows, nCols, &map);
+#endif
+
+#if PRINT_GENERATIONS
+        printf("\n=== WORLD %d ===\n", i);
+        printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+        exportGeneration(grid, nRows, nCols);
+#endif
+    }
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    free(grid);
+#endif
+    freeCellSets(sets, nSets);
+
+    return deathToll;
+}
@@ -0,0 +1,6 @@
+#ifndef HASHSET_H
+#define HASHSET_H
+
+long long goiHashSet(int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans);
+
+#endif
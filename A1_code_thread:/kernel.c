@@ -0,0 +1,587 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "util.h"
+#include "goi.h"
+#include "kernel.h"
+#include "alloc.h"
+
+/**
+ * Specifies the number(s) of live neighbors of the same faction required for a dead cell to become alive.
+ */
+bool isBirthable(int n)
+{
+    return n == 3;
+}
+
+/**
+ * Specifies the number(s) of live neighbors of the same faction required for a live cell to remain alive.
+ */
+bool isSurvivable(int n)
+{
+    return n == 2 || n == 3;
+}
+
+/**
+ * Specifies the number of live neighbors of a different faction required for a live cell to die due to fighting.
+ */
+bool willFight(int n) {
+    return n > 0;
+}
+
+/**
+ * Builds map from the factions found in the start world and all invasion plans.
+ */
+void buildFactionMap(factionMap *map, const int *startWorld, int nRows, int nCols, int nInvasions, int **invasionPlans)
+{
+    bool used[MAX_FACTIONS] = { false };
+    for (int i = -1; i < nInvasions; i++)
+    {
+        const int *grid = i < 0 ? startWorld : invasionPlans[i];
+        for (int row = 0; row < nRows; row++)
+        {
+            for (int col = 0; col < nCols; col++)
+            {
+                int faction = getValueAt(grid, nRows, nCols, row, col);
+                if (faction > DEAD_FACTION && faction < MAX_FACTIONS)
+                {
+                    used[faction] = true;
+                }
+            }
+        }
+    }
+
+    map->transposed = false;
+    map->nFactions = 0;
+    map->toDense[DEAD_FACTION] = DEAD_FACTION;
+    map->toFaction[DEAD_FACTION] = DEAD_FACTION;
+    for (int faction = DEAD_FACTION + 1; faction < MAX_FACTIONS; faction++)
+    {
+        map->toDense[faction] = DEAD_FACTION;
+        if (used[faction])
+        {
+            map->nFactions++;
+            map->toDense[faction] = map->nFactions;
+            map->toFaction[map->nFactions] = faction;
+        }
+    }
+}
+
+cell_t *allocPaddedGrid(int nRows, int nCols)
+{
+    return allocBuffer((size_t) (nRows + 2) * (nCols + 2) * sizeof(cell_t));
+}
+
+void freePaddedGrid(cell_t *grid)
+{
+    freeBuffer(grid);
+}
+
+/**
+ * Returns a pointer to the cell at column 0 of row; row may be -1 or nRows to reach the border.
+ */
+cell_t *paddedRow(cell_t *grid, int nCols, int row)
+{
+    return grid + (size_t) (row + 1) * (nCols + 2) + 1;
+}
+
+/**
+ * Copies cells [startCol, endCol) of row of grid into out, translating factions to dense ids. out
+ * is indexed by column, like the rows returned by paddedRow.
+ */
+void packRow(const int *grid, int nRows, int nCols, int row, int startCol, int endCol, cell_t *out, const factionMap *map)
+{
+    // row and every col are in range, so the cells are read directly rather than through getValueAt;
+    // a transposed grid is read down one of its columns
+    const int *cells = map->transposed ? grid + row : grid + (size_t) row * nCols;
+    size_t stride = map->transposed ? (size_t) nRows : 1;
+    for (int col = startCol; col < endCol; col++)
+    {
+        int faction = cells[(size_t) col * stride];
+        out[col] = faction > DEAD_FACTION && faction < MAX_FACTIONS ? map->toDense[faction] : DEAD_FACTION;
+    }
+}
+
+/**
+ * Copies grid into the interior of padded, translating factions to dense ids.
+ */
+void packGrid(const int *grid, cell_t *padded, int nRows, int nCols, const factionMap *map)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        packRow(grid, nRows, nCols, row, 0, nCols, paddedRow(padded, nCols, row), map);
+    }
+}
+
+/**
+ * Copies the interior of padded into grid, translating dense ids back to factions.
+ */
+void unpackGrid(const cell_t *padded, int *grid, int nRows, int nCols, const factionMap *map)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        const cell_t *in = paddedRow((cell_t *) padded, nCols, row);
+        for (int col = 0; col < nCols; col++)
+        {
+            if (map->transposed)
+            {
+                setValueAt(grid, nCols, nRows, col, row, map->toFaction[in[col]]);
+            }
+            else
+            {
+                setValueAt(grid, nRows, nCols, row, col, map->toFaction[in[col]]);
+            }
+        }
+    }
+}
+
+// the most live factions a histogram kernel is instantiated for (as stepRow9 below); above that,
+// stepRowMany takes over
+#define MAX_HISTOGRAM_FACTIONS 9
+
+// cells a vector of the invasion overlay holds
+#define VECTOR_CELLS (16 / (int) sizeof(cell_t))
+
+typedef cell_t cellVector __attribute__((vector_size(VECTOR_CELLS * sizeof(cell_t))));
+
+/**
+ * Row kernel part for rows an invasion lands on; the kernels below hand such rows over here, so their
+ * loops never check for invaders. The cells landed on take the invader without looking at their
+ * neighbors, and kernel (called without invaders) computes the runs of cells in between. Landings
+ * are found and counted 64 cells at a time from bit masks, and blended in a vector at a time.
+ */
+static int stepRowInvaded(rowKernel kernel, const cell_t *above, const cell_t *row, const cell_t *below,
+    const cell_t *invaders, cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    int deaths = 0;
+    // the first cell of the run kernel has yet to compute
+    int runStart = startCol;
+
+    for (int window = startCol; window < endCol; window += 64)
+    {
+        int width = endCol - window < 64 ? endCol - window : 64;
+        uint64_t landed = 0;
+        uint64_t alive = 0;
+        for (int i = 0; i < width; i++)
+        {
+            landed |= (uint64_t) (invaders[window + i] != DEAD_FACTION) << i;
+            alive |= (uint64_t) (row[window + i] != DEAD_FACTION) << i;
+        }
+        if (landed == 0)
+        {
+            continue;
+        }
+
+        // landing on a cell kills it
+        deaths += __builtin_popcountll(landed & alive);
+
+        // every run of landed cells ends a run for kernel
+        for (uint64_t rest = landed; rest != 0;)
+        {
+            int first = __builtin_ctzll(rest);
+            uint64_t notLanded = ~rest & (~0ull << first);
+            int last = notLanded == 0 ? 64 : __builtin_ctzll(notLanded);
+            if (window + first > runStart)
+            {
+                deaths += kernel(above, row, below, NULL, newRow, runStart, window + first, firstLive, lastLive);
+            }
+            runStart = window + last;
+            rest = last == 64 ? 0 : rest & (~0ull << last);
+        }
+
+        int vectorEnd = width / VECTOR_CELLS * VECTOR_CELLS;
+        for (int i = 0; i < vectorEnd; i += VECTOR_CELLS)
+        {
+            cellVector inv, next;
+            memcpy(&inv, invaders + window + i, sizeof(inv));
+            memcpy(&next, newRow + window + i, sizeof(next));
+            cellVector isLanded = (cellVector) (inv != DEAD_FACTION);
+            next = (inv & isLanded) | (next & ~isLanded);
+            memcpy(newRow + window + i, &next, sizeof(next));
+        }
+        for (int i = vectorEnd; i < width; i++)
+        {
+            newRow[window + i] = invaders[window + i] != DEAD_FACTION ? invaders[window + i] : newRow[window + i];
+        }
+
+        int firstLanded = window + __builtin_ctzll(landed);
+        int lastLanded = window + 63 - __builtin_clzll(landed);
+        if (firstLanded < *firstLive) *firstLive = firstLanded;
+        if (lastLanded > *lastLive) *lastLive = lastLanded;
+    }
+
+    if (runStart < endCol)
+    {
+        deaths += kernel(above, row, below, NULL, newRow, runStart, endCol, firstLive, lastLive);
+    }
+    return deaths;
+}
+
+/**
+ * Row kernel for worlds with nFactions live factions (as dense ids), without invaders. Always inlined
+ * into the wrappers below with a constant nFactions, so the faction histogram has a fixed size and its
+ * loops can be unrolled.
+ */
+static inline __attribute__((always_inline)) int stepRowFactions(int nFactions,
+    const cell_t *above, const cell_t *row, const cell_t *below,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    int deaths = 0;
+
+    for (int col = startCol; col < endCol; col++)
+    {
+        // faction of this cell
+        int cellFaction = row[col];
+        int nextState;
+
+        // tracks count of each faction adjacent to this cell
+        int neighborCounts[MAX_HISTOGRAM_FACTIONS + 1];
+        for (int faction = DEAD_FACTION; faction <= nFactions; faction++)
+        {
+            neighborCounts[faction] = 0;
+        }
+        neighborCounts[above[col - 1]]++;
+        neighborCounts[above[col]]++;
+        neighborCounts[above[col + 1]]++;
+        neighborCounts[row[col - 1]]++;
+        neighborCounts[row[col + 1]]++;
+        neighborCounts[below[col - 1]]++;
+        neighborCounts[below[col]]++;
+        neighborCounts[below[col + 1]]++;
+
+        if (cellFaction == DEAD_FACTION)
+        {
+            // need exactly 3 of a single faction; the highest such faction wins
+            nextState = DEAD_FACTION;
+            for (int faction = DEAD_FACTION + 1; faction <= nFactions; faction++)
+            {
+                if (isBirthable(neighborCounts[faction]))
+                {
+                    nextState = faction;
+                }
+            }
+        }
+        else
+        {
+            int hostileCount = 0;
+            for (int faction = DEAD_FACTION + 1; faction <= nFactions; faction++)
+            {
+                hostileCount += faction == cellFaction ? 0 : neighborCounts[faction];
+            }
+
+            if (willFight(hostileCount))
+            {
+                deaths++;
+                nextState = DEAD_FACTION;
+            }
+            else
+            {
+                nextState = isSurvivable(neighborCounts[cellFaction]) ? cellFaction : DEAD_FACTION;
+            }
+        }
+
+        newRow[col] = nextState;
+        if (nextState != DEAD_FACTION)
+        {
+            if (col < *firstLive) *firstLive = col;
+            *lastLive = col;
+        }
+    }
+
+    return deaths;
+}
+
+/**
+ * Row kernel for any number of live factions. Instead of a histogram over all factions, each cell
+ * only compares its (at most 8 distinct) neighbors with each other, so the cost per cell does not
+ * depend on how many factions the scenario has.
+ */
+static int stepRowMany(const cell_t *above, const cell_t *row, const cell_t *below, const cell_t *invaders,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    if (invaders != NULL)
+    {
+        return stepRowInvaded(stepRowMany, above, row, below, invaders, newRow, startCol, endCol, firstLive, lastLive);
+    }
+
+    int deaths = 0;
+
+    for (int col = startCol; col < endCol; col++)
+    {
+        cell_t cellFaction = row[col];
+        cell_t nextState = DEAD_FACTION;
+
+        cell_t neighbors[8] = {
+            above[col - 1], above[col], above[col + 1], row[col - 1],
+            row[col + 1], below[col - 1], below[col], below[col + 1]
+        };
+
+        int liveCount = 0;
+        int friendlyCount = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            liveCount += neighbors[i] != DEAD_FACTION;
+            friendlyCount += neighbors[i] == cellFaction;
+        }
+
+        if (cellFaction != DEAD_FACTION)
+        {
+            if (willFight(liveCount - friendlyCount))
+            {
+                deaths++;
+            }
+            else if (isSurvivable(friendlyCount))
+            {
+                nextState = cellFaction;
+            }
+        }
+        else if (liveCount >= 3)
+        {
+            // need exactly 3 of a single faction; the highest such faction wins
+            for (int i = 0; i < 8; i++)
+            {
+                if (neighbors[i] <= nextState)
+                {
+                    continue;
+                }
+                int count = 0;
+                for (int j = 0; j < 8; j++)
+                {
+                    count += neighbors[j] == neighbors[i];
+                }
+                if (isBirthable(count))
+                {
+                    nextState = neighbors[i];
+                }
+            }
+        }
+
+        newRow[col] = nextState;
+        if (nextState != DEAD_FACTION)
+        {
+            if (col < *firstLive) *firstLive = col;
+            *lastLive = col;
+        }
+    }
+
+    return deaths;
+}
+
+/**
+ * With at most two live factions, the next state of a cell is a function of its 3x3 neighborhood
+ * alone, so the rules above are evaluated once per neighborhood into tables and the kernels below
+ * only build table indices.
+ *
+ * A column of a neighborhood is coded as above + 3 * row + 9 * below (base 3, cells 0..2), or as
+ * the bits above | row << 1 | below << 2 with one faction. A neighborhood is its left, middle and
+ * right columns, most significant first.
+ */
+#define PAIR_COLUMN_CODES 27
+#define PAIR_PATTERNS (PAIR_COLUMN_CODES * PAIR_COLUMN_CODES * PAIR_COLUMN_CODES)
+#define LIFE_PATTERNS 512
+// 3 rows by 4 columns of one faction, the middle row of the classic 4x4 to 2x2 block table
+#define LIFE_BLOCK_PATTERNS 4096
+
+// entries of pairTable: the next state, plus PAIR_FIGHT if the cell dies fighting
+#define PAIR_STATE_MASK 3
+#define PAIR_FIGHT 4
+
+static uint8_t pairTable[PAIR_PATTERNS];
+static uint8_t lifeTable[LIFE_PATTERNS];
+// bit 0 is the next state of the second column of the block, bit 1 that of the third
+static uint8_t lifeBlockTable[LIFE_BLOCK_PATTERNS];
+static pthread_once_t ruleTablesOnce = PTHREAD_ONCE_INIT;
+
+static void buildRuleTables(void)
+{
+    cell_t above[3], row[3], below[3];
+    int deaths;
+    int firstLive = 1, lastLive = 0;
+
+    for (int pattern = 0; pattern < PAIR_PATTERNS; pattern++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            int code = pattern;
+            for (int i = col; i < 2; i++)
+            {
+                code /= PAIR_COLUMN_CODES;
+            }
+            code %= PAIR_COLUMN_CODES;
+            above[col] = code % 3;
+            row[col] = code / 3 % 3;
+            below[col] = code / 9;
+        }
+        cell_t next;
+        deaths = stepRowFactions(2, above + 1, row + 1, below + 1, &next, 0, 1, &firstLive, &lastLive);
+        pairTable[pattern] = next | (deaths ? PAIR_FIGHT : 0);
+    }
+
+    for (int pattern = 0; pattern < LIFE_PATTERNS; pattern++)
+    {
+        // with one faction the bit codes are base 3 codes with digits 0 and 1
+        int code = 0;
+        for (int col = 0; col < 3; col++)
+        {
+            int bits = pattern >> (3 * (2 - col)) & 7;
+            code = code * PAIR_COLUMN_CODES + (bits & 1) + 3 * (bits >> 1 & 1) + 9 * (bits >> 2);
+        }
+        lifeTable[pattern] = pairTable[code] & PAIR_STATE_MASK;
+    }
+
+    for (int pattern = 0; pattern < LIFE_BLOCK_PATTERNS; pattern++)
+    {
+        lifeBlockTable[pattern] = lifeTable[pattern >> 3] | lifeTable[pattern & (LIFE_PATTERNS - 1)] << 1;
+    }
+}
+
+/**
+ * Row kernel for a single live faction using the block table: two cells per lookup, sliding the
+ * 4 column window two columns at a time. An odd last cell uses lifeTable.
+ */
+static int stepRowLifeTable(const cell_t *above, const cell_t *row, const cell_t *below, const cell_t *invaders,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    if (invaders != NULL)
+    {
+        return stepRowInvaded(stepRowLifeTable, above, row, below, invaders, newRow, startCol, endCol, firstLive, lastLive);
+    }
+
+#define LIFE_COLUMN(col) (above[col] | row[col] << 1 | below[col] << 2)
+    int col = startCol;
+    // the 2 columns left of the next block
+    unsigned window = LIFE_COLUMN(col - 1) << 3 | LIFE_COLUMN(col);
+
+    for (; col + 1 < endCol; col += 2)
+    {
+        window = (window << 6 | LIFE_COLUMN(col + 1) << 3 | LIFE_COLUMN(col + 2)) & (LIFE_BLOCK_PATTERNS - 1);
+        unsigned block = lifeBlockTable[window];
+        newRow[col] = block & 1;
+        newRow[col + 1] = block >> 1;
+        if (block != 0)
+        {
+            if (col < *firstLive) *firstLive = newRow[col] ? col : col + 1;
+            *lastLive = newRow[col + 1] ? col + 1 : col;
+        }
+    }
+
+    if (col < endCol)
+    {
+        newRow[col] = lifeTable[(window & 0x3f) << 3 | LIFE_COLUMN(col + 1)];
+        if (newRow[col] != DEAD_FACTION)
+        {
+            if (col < *firstLive) *firstLive = col;
+            *lastLive = col;
+        }
+    }
+#undef LIFE_COLUMN
+
+    // a single faction never fights
+    return 0;
+}
+
+/**
+ * Computes cells [startCol, endCol) of the next state of row into newRow, for a neighborhood where every
+ * live cell belongs to faction: Life on the block table, with no fighting and no invasion. Lowers
+ * *firstLive and raises *lastLive to cover the live cells written. selectRowKernel must have been called
+ * before, to build the tables.
+ */
+void stepRowOneFaction(cell_t faction, const cell_t *above, const cell_t *row, const cell_t *below,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+#define LIVE_COLUMN(col) ((above[col] != DEAD_FACTION) | (row[col] != DEAD_FACTION) << 1 | (below[col] != DEAD_FACTION) << 2)
+    int col = startCol;
+    unsigned window = LIVE_COLUMN(col - 1) << 3 | LIVE_COLUMN(col);
+
+    for (; col + 1 < endCol; col += 2)
+    {
+        window = (window << 6 | LIVE_COLUMN(col + 1) << 3 | LIVE_COLUMN(col + 2)) & (LIFE_BLOCK_PATTERNS - 1);
+        unsigned block = lifeBlockTable[window];
+        newRow[col] = (block & 1) * faction;
+        newRow[col + 1] = (block >> 1) * faction;
+        if (block != 0)
+        {
+            if (col < *firstLive) *firstLive = block & 1 ? col : col + 1;
+            *lastLive = block & 2 ? col + 1 : col;
+        }
+    }
+
+    if (col < endCol)
+    {
+        newRow[col] = lifeTable[(window & 0x3f) << 3 | LIVE_COLUMN(col + 1)] * faction;
+        if (newRow[col] != DEAD_FACTION)
+        {
+            if (col < *firstLive) *firstLive = col;
+            *lastLive = col;
+        }
+    }
+#undef LIVE_COLUMN
+}
+
+/**
+ * Row kernel for two live factions using pairTable, whose entries also tell fighting deaths.
+ */
+static int stepRowPairTable(const cell_t *above, const cell_t *row, const cell_t *below, const cell_t *invaders,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    if (invaders != NULL)
+    {
+        return stepRowInvaded(stepRowPairTable, above, row, below, invaders, newRow, startCol, endCol, firstLive, lastLive);
+    }
+
+#define PAIR_COLUMN(col) (above[col] + 3 * row[col] + 9 * below[col])
+    int deaths = 0;
+    // the left and middle columns of the next neighborhood
+    unsigned columns = PAIR_COLUMN(startCol - 1) * PAIR_COLUMN_CODES + PAIR_COLUMN(startCol);
+
+    for (int col = startCol; col < endCol; col++)
+    {
+        unsigned index = columns * PAIR_COLUMN_CODES + PAIR_COLUMN(col + 1);
+        columns = index % (PAIR_COLUMN_CODES * PAIR_COLUMN_CODES);
+
+        unsigned entry = pairTable[index];
+        cell_t nextState = entry & PAIR_STATE_MASK;
+        deaths += entry >> 2;
+
+        newRow[col] = nextState;
+        if (nextState != DEAD_FACTION)
+        {
+            if (col < *firstLive) *firstLive = col;
+            *lastLive = col;
+        }
+    }
+#undef PAIR_COLUMN
+
+    return deaths;
+}
+
+#define DEFINE_ROW_KERNEL(N)                                                                       \
+    static int stepRow##N(const cell_t *above, const cell_t *row, const cell_t *below,          \
+        const cell_t *invaders, cell_t *newRow, int startCol, int endCol, int *firstLive,          \
+        int *lastLive)                                                                             \
+    {                                                                                              \
+        if (invaders != NULL)                                                                      \
+        {                                                                                          \
+            return stepRowInvaded(stepRow##N, above, row, below, invaders, newRow, startCol, endCol, \
+                firstLive, lastLive);                                                              \
+        }                                                                                          \
+        return stepRowFactions(N, above, row, below, newRow, startCol, endCol, firstLive, lastLive); \
+    }
+
+DEFINE_ROW_KERNEL(4)
+DEFINE_ROW_KERNEL(9)
+
+/**
+ * Returns the cheapest row kernel that handles nFactions live factions.
+ */
+rowKernel selectRowKernel(int nFactions)
+{
+    pthread_once(&ruleTablesOnce, buildRuleTables);
+    if (nFactions <= 1) return stepRowLifeTable;
+    if (nFactions <= 2) return stepRowPairTable;
+    if (nFactions <= 4) return stepRow4;
+    if (nFactions <= MAX_HISTOGRAM_FACTIONS) return stepRow9;
+    return stepRowMany;
+}
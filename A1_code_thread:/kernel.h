@@ -0,0 +1,52 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdbool.h>
+#include "goi.h"
+
+bool isBirthable(int n);
+bool isSurvivable(int n);
+bool willFight(int n);
+
+/**
+ * Maps the factions that actually appear in a scenario to dense ids 1..nFactions, in increasing
+ * order, so kernels only need to consider the factions in use. DEAD_FACTION maps to itself.
+ *
+ * If transposed is set, the cell at (row, col) of a simulated grid is the one at (col, row) of the
+ * grids from main.c. The functions below all take the dimensions of the simulated grid.
+ */
+typedef struct factionMapStruct {
+    int nFactions;
+    cell_t toDense[MAX_FACTIONS];
+    int toFaction[MAX_FACTIONS];
+    bool transposed;
+} factionMap;
+
+void buildFactionMap(factionMap *map, const int *startWorld, int nRows, int nCols, int nInvasions, int **invasionPlans);
+
+/**
+ * Padded grids: nRows x nCols cells surrounded by a border of dead cells, one cell wide, stored
+ * row-major with a stride of nCols + 2. The border lets kernels read every neighbor without bounds
+ * checks. Cells hold dense faction ids.
+ */
+cell_t *allocPaddedGrid(int nRows, int nCols);
+void freePaddedGrid(cell_t *grid);
+cell_t *paddedRow(cell_t *grid, int nCols, int row);
+void packRow(const int *grid, int nRows, int nCols, int row, int startCol, int endCol, cell_t *out, const factionMap *map);
+void packGrid(const int *grid, cell_t *padded, int nRows, int nCols, const factionMap *map);
+void unpackGrid(const cell_t *padded, int *grid, int nRows, int nCols, const factionMap *map);
+
+/**
+ * Computes cells [startCol, endCol) of the next state of row into newRow, given the padded rows
+ * above and below it and (optionally, can be NULL) the padded invasion row landing this generation.
+ * Returns the number of deaths due to fighting. Lowers *firstLive and raises *lastLive to cover the
+ * live cells written.
+ */
+typedef int (*rowKernel)(const cell_t *above, const cell_t *row, const cell_t *below, const cell_t *invaders,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive);
+
+rowKernel selectRowKernel(int nFactions);
+void stepRowOneFaction(cell_t faction, const cell_t *above, const cell_t *row, const cell_t *below,
+    cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive);
+
+#endif
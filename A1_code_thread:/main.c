@@ -12,13 +12,21 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include "util.h"
 #include "exporter.h"
+#include "frames.h"
 #include "settings.h"
 #include "goi.h"
+#include "outofcore.h"
+#include "alloc.h"
+#include "batch.h"
+#include "deathstream.h"
+#include "attribution.h"
 
 int readParam(FILE *fp, char **line, size_t *len, int *param);
 int readWorldLayout(FILE *fp, char **line, size_t *len, int *world, int nRows, int nCols);
+void runBatchFile(FILE *batchFile, FILE *outputFile, int nThreads);
 
 /**
  * Handles input, output and file open/close operations. Delegates simulation to goi.
@@ -41,11 +49,9 @@ int main(int argc, char *argv[])
 
     if (argc < 4)
     {
-#if EXPORT_GENERATIONS
-        fprintf(stderr, "Usage: %s <INPUT_PATH> <OUTPUT_PATH> <NUM_THREADS> [<OPT_EXPORT_PATH>]\n", argv[0]);
-#else
-        fprintf(stderr, "Usage: %s <INPUT_PATH> <OUTPUT_PATH> <NUM_THREADS>\n", argv[0]);
-#endif
+        fprintf(stderr, "Usage: %s <INPUT_PATH> <OUTPUT_PATH> <NUM_THREADS>%s%s%s\n", argv[0],
+                EXPORT_GENERATIONS ? " [<OPT_EXPORT_PATH>]" : "", STREAM_DEATHS ? " [<OPT_DEATHS_PATH>]" : "",
+                ATTRIBUTE_DEATHS ? " [<OPT_ATTRIBUTION_PATH>]" : "");
         exit(EXIT_FAILURE);
     }
 
@@ -59,7 +65,43 @@ int main(int argc, char *argv[])
     {
         printf("<OPT_EXPORT_PATH>: %s\n", argv[4]);
         exportFile = fopen(argv[4], "w");
+#if EXPORT_FRAMES || EXPORT_COMPRESSION
+        initFrameExporter(exportFile);
+#else
         initWorldExporter(exportFile);
+#endif
+    }
+#endif
+
+#if STREAM_DEATHS && !BATCH_RUNS
+    FILE *deathsFile = NULL;
+    int deathsArg = EXPORT_GENERATIONS ? 5 : 4;
+    if (argc > deathsArg)
+    {
+        printf("<OPT_DEATHS_PATH>: %s\n", argv[deathsArg]);
+        deathsFile = fopen(argv[deathsArg], "w");
+        if (deathsFile == NULL)
+        {
+            fprintf(stderr, "Failed to open %s for writing. Aborting...\n", argv[deathsArg]);
+            exit(EXIT_FAILURE);
+        }
+        initDeathStream(deathsFile);
+    }
+#endif
+
+#if ATTRIBUTE_DEATHS && !OUT_OF_CORE && !BATCH_RUNS
+    FILE *attributionFile = NULL;
+    int attributionArg = 4 + (EXPORT_GENERATIONS ? 1 : 0) + (STREAM_DEATHS ? 1 : 0);
+    if (argc > attributionArg)
+    {
+        printf("<OPT_ATTRIBUTION_PATH>: %s\n", argv[attributionArg]);
+        attributionFile = fopen(argv[attributionArg], "w");
+        if (attributionFile == NULL)
+        {
+            fprintf(stderr, "Failed to open %s for writing. Aborting...\n", argv[attributionArg]);
+            exit(EXIT_FAILURE);
+        }
+        initAttribution(attributionFile);
     }
 #endif
 
@@ -89,6 +131,14 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+#if BATCH_RUNS
+    // the input lists the scenario files to run
+    runBatchFile(inputFile, outputFile, nThreads);
+    fclose(inputFile);
+    fclose(outputFile);
+    return 0;
+#endif
+
     // Read nGenerations
     if (readParam(inputFile, &line, &len, &nGenerations) == -1)
     {
@@ -116,8 +166,43 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+#if OUT_OF_CORE
+    // the scenario may not fit in memory, so the engine reads the rest of the input itself
+    startWorld = NULL;
+    nInvasions = 0;
+    invasionTimes = NULL;
+    invasionPlans = NULL;
+    long long warDeathToll = goiOutOfCore(nThreads, nGenerations, nRows, nCols, inputFile, &line, &len);
+
+    // we're done with the file
+    fclose(inputFile);
+    if (line)
+    {
+        free(line);
+    }
+#else
+#if ARENA_ALLOCATION
+    // plan the run from the header: the start world, then everything goi allocates
+    size_t planBytes = arenaBytes(sizeof(int) * nRows * nCols);
+    size_t plannedBytes = arenaBytes(sizeof(int) * nRows * nCols) + goiArenaSize(nThreads, nRows, nCols);
+
+    // each cell takes at least 2 characters of input, which bounds how many invasions can follow
+    struct stat inputStat;
+    long maxInvasions = 0;
+    if (fstat(fileno(inputFile), &inputStat) == 0 && ftell(inputFile) >= 0)
+    {
+        maxInvasions = (inputStat.st_size - ftell(inputFile)) / (2 * (long) nRows * nCols);
+    }
+    size_t invasionBytes = arenaBytes(sizeof(int) * maxInvasions) + arenaBytes(sizeof(int *) * maxInvasions)
+        + maxInvasions * planBytes;
+    if (initArena(plannedBytes + invasionBytes) == 0)
+    {
+        prefaultArena(plannedBytes);
+    }
+#endif
+
     // Read start world
-    startWorld = malloc(sizeof(int) * nRows * nCols);
+    startWorld = allocBuffer(sizeof(int) * nRows * nCols);
     if (startWorld == NULL || readWorldLayout(inputFile, &line, &len, startWorld, nRows, nCols) == -1)
     {
         fprintf(stderr, "Failed to read STARTING_WORLD. Aborting...\n");
@@ -131,9 +216,15 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+#if ARENA_ALLOCATION
+    // now the invasions are known, fault in their part too
+    prefaultArena(plannedBytes + arenaBytes(sizeof(int) * nInvasions) + arenaBytes(sizeof(int *) * nInvasions)
+        + nInvasions * planBytes);
+#endif
+
     // Read invasions
-    invasionTimes = malloc(sizeof(int) * nInvasions);
-    invasionPlans = malloc(sizeof(int *) * nInvasions);
+    invasionTimes = allocBuffer(sizeof(int) * nInvasions);
+    invasionPlans = allocBuffer(sizeof(int *) * nInvasions);
     if (invasionTimes == NULL || invasionPlans == NULL)
     {
         fprintf(stderr, "No memory for invasions. Aborting...\n");
@@ -147,7 +238,7 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
 
-        invasionPlans[i] = malloc(sizeof(int) * nRows * nCols);
+        invasionPlans[i] = allocBuffer(sizeof(int) * nRows * nCols);
         if (invasionPlans[i] == NULL || readWorldLayout(inputFile, &line, &len, invasionPlans[i], nRows, nCols))
         {
             fprintf(stderr, "Failed to read INVASION_PLAN. Aborting...\n");
@@ -174,27 +265,176 @@ int main(int argc, char *argv[])
     }
 
     // run the simulation
-    int warDeathToll = goi(nThreads, nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+    long long warDeathToll = goi(nThreads, nGenerations, startWorld, nRows, nCols, nInvasions, invasionTimes, invasionPlans);
+#endif
+
+    // the engines return -1 if they ran out of memory or disk
+    if (warDeathToll < 0)
+    {
+        fprintf(stderr, "Simulation failed: out of memory or disk. Aborting...\n");
+        exit(EXIT_FAILURE);
+    }
 
     // output the result
-    fprintf(outputFile, "%d", warDeathToll);
+    fprintf(outputFile, "%lld", warDeathToll);
     fclose(outputFile);
 
+#if HUGE_PAGES
+    printf("<HUGE_PAGES>: %s\n", hugePageReport());
+#endif
+
 #if EXPORT_GENERATIONS
     if (exportFile != NULL)
     {
+#if EXPORT_FRAMES || EXPORT_COMPRESSION
+        finishFrameExporter();
+#endif
         fclose(exportFile);
     }
 #endif
 
+#if STREAM_DEATHS && !BATCH_RUNS
+    if (deathsFile != NULL)
+    {
+        finishDeathStream();
+        fclose(deathsFile);
+    }
+#endif
+
+#if ATTRIBUTE_DEATHS && !OUT_OF_CORE && !BATCH_RUNS
+    if (attributionFile != NULL)
+    {
+        fclose(attributionFile);
+    }
+#endif
+
     // free everything!
     for (int i = 0; i < nInvasions; i++)
     {
-        free(invasionPlans[i]);
+        freeBuffer(invasionPlans[i]);
+    }
+    freeBuffer(invasionTimes);
+    freeBuffer(invasionPlans);
+    freeBuffer(startWorld);
+#if ARENA_ALLOCATION
+    freeArena();
+#endif
+}
+
+// readScenarioFrom reads a whole scenario from fp into s. -1 is returned on error.
+int readScenarioFrom(FILE *fp, char **line, size_t *len, scenario *s)
+{
+    s->startWorld = NULL;
+    s->nInvasions = 0;
+    s->invasionTimes = NULL;
+    s->invasionPlans = NULL;
+
+    if (readParam(fp, line, len, &s->nGenerations) == -1 || readParam(fp, line, len, &s->nRows) == -1
+        || readParam(fp, line, len, &s->nCols) == -1 || s->nRows == 0 || s->nCols == 0)
+    {
+        return -1;
+    }
+    s->startWorld = allocBuffer(sizeof(int) * s->nRows * s->nCols);
+    if (s->startWorld == NULL || readWorldLayout(fp, line, len, s->startWorld, s->nRows, s->nCols) == -1
+        || readParam(fp, line, len, &s->nInvasions) == -1)
+    {
+        return -1;
+    }
+    s->invasionTimes = allocBuffer(sizeof(int) * s->nInvasions);
+    s->invasionPlans = allocBuffer(sizeof(int *) * s->nInvasions);
+    if (s->invasionTimes == NULL || s->invasionPlans == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < s->nInvasions; i++)
+    {
+        s->invasionPlans[i] = allocBuffer(sizeof(int) * s->nRows * s->nCols);
+        if (readParam(fp, line, len, s->invasionTimes + i) == -1 || s->invasionPlans[i] == NULL
+            || readWorldLayout(fp, line, len, s->invasionPlans[i], s->nRows, s->nCols) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// readScenario reads a whole scenario from the file at path into s. -1 is returned on error.
+int readScenario(const char *path, scenario *s)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t len = 0;
+    // readWorldLayout checks errno, which earlier calls may have set
+    errno = 0;
+    int rc = readScenarioFrom(fp, &line, &len, s);
+    fclose(fp);
+    free(line);
+    return rc;
+}
+
+// runBatchFile runs the scenarios whose files batchFile lists, one path per line, and writes their
+// death tolls to outputFile, one per line in the same order.
+void runBatchFile(FILE *batchFile, FILE *outputFile, int nThreads)
+{
+    char *line = NULL;
+    size_t len = 0;
+    scenario *scenarios = NULL;
+    int nScenarios = 0;
+
+    while (getline(&line, &len, batchFile) != -1)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+        {
+            continue;
+        }
+        scenario *grown = realloc(scenarios, sizeof(scenario) * (nScenarios + 1));
+        if (grown == NULL)
+        {
+            fprintf(stderr, "No memory for scenarios. Aborting...\n");
+            exit(EXIT_FAILURE);
+        }
+        scenarios = grown;
+        if (readScenario(line, &scenarios[nScenarios]) == -1)
+        {
+            fprintf(stderr, "Failed to read scenario %s. Aborting...\n", line);
+            exit(EXIT_FAILURE);
+        }
+        nScenarios++;
+    }
+    free(line);
+
+    long long *deathTolls = malloc(sizeof(long long) * (nScenarios + 1));
+    if (deathTolls == NULL)
+    {
+        fprintf(stderr, "No memory for scenarios. Aborting...\n");
+        exit(EXIT_FAILURE);
+    }
+    runBatch(nThreads, scenarios, nScenarios, deathTolls);
+
+    for (int i = 0; i < nScenarios; i++)
+    {
+        // lines stay in scenario order, so a failed run still gets its line
+        if (deathTolls[i] < 0)
+        {
+            fprintf(stderr, "Scenario %d failed: out of memory or disk.\n", i);
+        }
+        fprintf(outputFile, "%lld\n", deathTolls[i]);
+        for (int j = 0; j < scenarios[i].nInvasions; j++)
+        {
+            freeBuffer(scenarios[i].invasionPlans[j]);
+        }
+        freeBuffer(scenarios[i].invasionTimes);
+        freeBuffer(scenarios[i].invasionPlans);
+        freeBuffer(scenarios[i].startWorld);
     }
-    free(invasionTimes);
-    free(invasionPlans);
-    free(startWorld);
+    free(deathTolls);
+    free(scenarios);
 }
 
 // readParam reads one integer from a line into param, advancing the read head to the next line.
@@ -0,0 +1,177 @@
+/**
+ * Memoization of row segments, enabled by MEMO_ROWS.
+ *
+ * The next state of MEMO_SEGMENT cells of a row only depends on MEMO_SEGMENT + 2 cells of each of the
+ * row above, the row itself and the row below. Worlds with long empty stretches or repeating bands keep
+ * producing the same such triples, so their results (with the number of deaths due to fighting) are
+ * kept in a table shared by all threads, and only computed on a miss.
+ *
+ * The table is open-addressed with a short probe sequence and never evicts. Each slot is written once:
+ * a thread claims an empty slot, fills it in, then publishes it; other threads only read published
+ * slots, and skip slots that are being filled in.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "goi.h"
+#include "kernel.h"
+#include "memo.h"
+#include "alloc.h"
+
+#define MEMO_TABLE_BITS 16
+#define MEMO_TABLE_SIZE (1 << MEMO_TABLE_BITS)
+#define MEMO_PROBES 4
+
+#define KEY_CELLS (3 * (MEMO_SEGMENT + 2))
+// the key is hashed 8 bytes at a time
+#define KEY_WORDS ((KEY_CELLS * sizeof(cell_t) + 7) / 8)
+
+enum { SLOT_EMPTY, SLOT_FILLING, SLOT_READY };
+
+typedef struct memoSlotStruct {
+    atomic_int state;
+    uint32_t hash;
+    uint64_t key[KEY_WORDS];
+    cell_t result[MEMO_SEGMENT];
+    // offsets of the first and last live cells of result, -1 if there are none
+    int8_t firstLive;
+    int8_t lastLive;
+    int8_t deaths;
+} memoSlot;
+
+struct memoTableStruct {
+    memoSlot slots[MEMO_TABLE_SIZE];
+};
+
+size_t memoTableSize(void)
+{
+    return sizeof(memoTable);
+}
+
+memoTable *createMemoTable(void)
+{
+    // all zeroes is all slots SLOT_EMPTY
+    return allocBuffer(sizeof(memoTable));
+}
+
+void freeMemoTable(memoTable *memo)
+{
+    freeBuffer(memo);
+}
+
+static uint32_t hashKey(const uint64_t *key)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < KEY_WORDS; i++)
+    {
+        h = (h ^ key[i]) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return (uint32_t) h;
+}
+
+/**
+ * Steps the segment of MEMO_SEGMENT cells starting at col, through the table.
+ */
+static int stepSegment(memoTable *memo, rowKernel kernel, const cell_t *above, const cell_t *row, const cell_t *below,
+    cell_t *newRow, int col, int *firstLive, int *lastLive)
+{
+    uint64_t key[KEY_WORDS] = { 0 };
+    cell_t *keyCells = (cell_t *) key;
+    memcpy(keyCells, above + col - 1, (MEMO_SEGMENT + 2) * sizeof(cell_t));
+    memcpy(keyCells + MEMO_SEGMENT + 2, row + col - 1, (MEMO_SEGMENT + 2) * sizeof(cell_t));
+    memcpy(keyCells + 2 * (MEMO_SEGMENT + 2), below + col - 1, (MEMO_SEGMENT + 2) * sizeof(cell_t));
+    uint32_t hash = hashKey(key);
+
+    memoSlot *claimed = NULL;
+    for (int probe = 0; probe < MEMO_PROBES; probe++)
+    {
+        memoSlot *slot = &memo->slots[(hash + probe) & (MEMO_TABLE_SIZE - 1)];
+        int state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (state == SLOT_READY)
+        {
+            if (slot->hash == hash && memcmp(slot->key, key, sizeof(key)) == 0)
+            {
+                memcpy(newRow + col, slot->result, MEMO_SEGMENT * sizeof(cell_t));
+                if (slot->lastLive >= 0)
+                {
+                    if (col + slot->firstLive < *firstLive) *firstLive = col + slot->firstLive;
+                    *lastLive = col + slot->lastLive;
+                }
+                return slot->deaths;
+            }
+        }
+        else if (state == SLOT_EMPTY && atomic_compare_exchange_strong(&slot->state, &state, SLOT_FILLING))
+        {
+            claimed = slot;
+            break;
+        }
+    }
+
+    int segmentFirst = col + MEMO_SEGMENT;
+    int segmentLast = -1;
+    int deaths = kernel(above, row, below, NULL, newRow, col, col + MEMO_SEGMENT, &segmentFirst, &segmentLast);
+    if (segmentLast >= 0)
+    {
+        if (segmentFirst < *firstLive) *firstLive = segmentFirst;
+        *lastLive = segmentLast;
+    }
+
+    if (claimed != NULL)
+    {
+        claimed->hash = hash;
+        memcpy(claimed->key, key, sizeof(key));
+        memcpy(claimed->result, newRow + col, MEMO_SEGMENT * sizeof(cell_t));
+        claimed->firstLive = segmentLast >= 0 ? segmentFirst - col : -1;
+        claimed->lastLive = segmentLast >= 0 ? segmentLast - col : -1;
+        claimed->deaths = deaths;
+        atomic_store_explicit(&claimed->state, SLOT_READY, memory_order_release);
+    }
+    return deaths;
+}
+
+static bool anyInvader(const cell_t *invaders, int startCol, int endCol)
+{
+    for (int col = startCol; col < endCol; col++)
+    {
+        if (invaders[col] != DEAD_FACTION)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Same contract as a rowKernel, with the row split into segments aligned to MEMO_SEGMENT columns that
+ * are looked up in memo. Partial segments at either end, and segments an invader lands in, are
+ * computed directly with kernel.
+ */
+int stepRowMemo(memoTable *memo, rowKernel kernel, const cell_t *above, const cell_t *row, const cell_t *below,
+    const cell_t *invaders, cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive)
+{
+    int deaths = 0;
+    int col = startCol;
+    while (col < endCol)
+    {
+        int segmentEnd = (col / MEMO_SEGMENT + 1) * MEMO_SEGMENT;
+        if (segmentEnd > endCol)
+        {
+            segmentEnd = endCol;
+        }
+
+        if (col % MEMO_SEGMENT == 0 && segmentEnd - col == MEMO_SEGMENT
+            && (invaders == NULL || !anyInvader(invaders, col, segmentEnd)))
+        {
+            deaths += stepSegment(memo, kernel, above, row, below, newRow, col, firstLive, lastLive);
+        }
+        else
+        {
+            deaths += kernel(above, row, below, invaders, newRow, col, segmentEnd, firstLive, lastLive);
+        }
+        col = segmentEnd;
+    }
+    return deaths;
+}
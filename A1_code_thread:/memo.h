@@ -0,0 +1,19 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "goi.h"
+#include "kernel.h"
+
+// cells per memoized row segment
+#define MEMO_SEGMENT 16
+
+typedef struct memoTableStruct memoTable;
+
+size_t memoTableSize(void);
+memoTable *createMemoTable(void);
+void freeMemoTable(memoTable *memo);
+
+int stepRowMemo(memoTable *memo, rowKernel kernel, const cell_t *above, const cell_t *row, const cell_t *below,
+    const cell_t *invaders, cell_t *newRow, int startCol, int endCol, int *firstLive, int *lastLive);
+
+#endif
@@ -0,0 +1,487 @@
+/**
+ * Engine for worlds that do not fit in memory, enabled by OUT_OF_CORE.
+ *
+ * main.c hands over the input file right after the dimensions, and the start world and invasion plans are
+ * read one row at a time into temporary files on disk, one cell_t per cell. Each pass over the world file
+ * then computes up to OOC_PASS_GENERATIONS generations: bands of OOC_BAND_ROWS rows are read in turn, and
+ * every generation of the pass keeps a ring of its last OOC_BAND_ROWS + 2 rows, so that a row of generation
+ * k is computed as soon as the rows around it of generation k - 1 are. Only rows of the last generation of
+ * the pass are written back, so a pass costs one read and one write of the world file however many
+ * generations it covers. Invasions landing during a pass are read row by row as their generation sweeps by.
+ *
+ * Factions are kept as given; the row kernels only need them ordered, and the histogram kernels only need
+ * them no bigger than the faction count they are selected for (see selectRowKernel).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "util.h"
+#include "frames.h"
+#include "settings.h"
+#include "goi.h"
+#include "kernel.h"
+#include "outofcore.h"
+#include "deathstream.h"
+
+// rows of each generation kept in memory: a band, and the rows on either side of it
+#define RING_ROWS (OOC_BAND_ROWS + 2)
+
+typedef struct oocSharedStruct {
+    rowKernel kernel;
+    int nRows;
+    int nCols;
+    // rings[k] holds the last RING_ROWS rows of generation k of the pass, see ringRow
+    cell_t **rings;
+    // an all-dead padded row, standing for the rows past the edges
+    const cell_t *deadRow;
+    int planFd;
+    // this round, rows [startRow, endRow) of generation level are computed, with invasion plan (or -1)
+    int level;
+    int startRow;
+    int endRow;
+    int plan;
+    // set when workers should return
+    bool quit;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+} oocShared;
+
+typedef struct oocWorkerStruct {
+    oocShared *shared;
+    pthread_t thread;
+    int tid;
+    int nThreads;
+    // the invasion row being landed, indexed by column
+    cell_t *invRow;
+    long long deaths;
+    bool failed;
+} oocWorker;
+
+/**
+ * Returns the padded row of generation level; rows past the edges are dead.
+ */
+static cell_t *ringRow(const oocShared *shared, int level, int row)
+{
+    if (row < 0 || row >= shared->nRows)
+    {
+        return (cell_t *) shared->deadRow + 1;
+    }
+    return shared->rings[level] + (size_t) (row % RING_ROWS) * (shared->nCols + 2) + 1;
+}
+
+static bool readAll(int fd, void *buf, size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t got = pread(fd, buf, size, offset);
+        if (got <= 0)
+        {
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        buf = (char *) buf + got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *buf, size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t put = pwrite(fd, buf, size, offset);
+        if (put < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        buf = (const char *) buf + put;
+        size -= put;
+        offset += put;
+    }
+    return true;
+}
+
+static off_t rowOffset(int nRows, int nCols, int grid, int row)
+{
+    return ((off_t) grid * nRows + row) * nCols * (off_t) sizeof(cell_t);
+}
+
+/**
+ * Reads a world layout of nRows lines, like readWorldLayout of main.c, into grid number grid of the file fd.
+ * Raises *maxFaction to the largest faction read. Returns -1 on error.
+ */
+static int readLayoutToFile(FILE *fp, char **line, size_t *len, int fd, int grid, int nRows, int nCols,
+    cell_t *rowCells, int *maxFaction)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        if (getline(line, len, fp) == -1)
+        {
+            return -1;
+        }
+
+        char *p = *line;
+        for (int col = 0; col < nCols; col++)
+        {
+            char *end;
+            int cell = strtol(p, &end, 10);
+
+            // unexpected end
+            if (cell == 0 && end == p)
+            {
+                return -1;
+            }
+
+            // other errors
+            if (errno == EINVAL || errno == ERANGE)
+            {
+                return -1;
+            }
+
+            bool alive = cell > DEAD_FACTION && cell < MAX_FACTIONS;
+            rowCells[col] = alive ? cell : DEAD_FACTION;
+            if (alive && cell > *maxFaction)
+            {
+                *maxFaction = cell;
+            }
+            p = end;
+        }
+
+        if (!writeAll(fd, rowCells, sizeof(cell_t) * nCols, rowOffset(nRows, nCols, grid, row)))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *oocSubroutine(void *arg)
+{
+    oocWorker *worker = (oocWorker *) arg;
+    oocShared *shared = worker->shared;
+    int nRows = shared->nRows;
+    int nCols = shared->nCols;
+
+    while (true)
+    {
+        // wait for goiOutOfCore to set up this round
+        pthread_barrier_wait(&shared->start);
+        if (shared->quit)
+        {
+            return NULL;
+        }
+
+        int nRoundRows = shared->endRow - shared->startRow;
+        int startRow = shared->startRow + (int) ((long) nRoundRows * worker->tid / worker->nThreads);
+        int endRow = shared->startRow + (int) ((long) nRoundRows * (worker->tid + 1) / worker->nThreads);
+        int level = shared->level;
+        long long deaths = 0;
+        for (int row = startRow; row < endRow && !worker->failed; row++)
+        {
+            const cell_t *invaders = NULL;
+            if (shared->plan >= 0)
+            {
+                worker->failed = !readAll(shared->planFd, worker->invRow, sizeof(cell_t) * nCols,
+                    rowOffset(nRows, nCols, shared->plan, row));
+                invaders = worker->invRow;
+            }
+
+            int firstLive = nCols;
+            int lastLive = -1;
+            deaths += shared->kernel(ringRow(shared, level - 1, row - 1), ringRow(shared, level - 1, row),
+                ringRow(shared, level - 1, row + 1), invaders, ringRow(shared, level, row), 0, nCols,
+                &firstLive, &lastLive);
+        }
+        worker->deaths = deaths;
+
+        pthread_barrier_wait(&shared->done);
+    }
+}
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+/**
+ * Reads grid number 0 of fd into the int grid, for printing and export.
+ */
+static bool loadWorld(int fd, int *grid, int nRows, int nCols, cell_t *rowCells)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        if (!readAll(fd, rowCells, sizeof(cell_t) * nCols, rowOffset(nRows, nCols, 0, row)))
+        {
+            return false;
+        }
+        for (int col = 0; col < nCols; col++)
+        {
+            setValueAt(grid, nRows, nCols, row, col, rowCells[col]);
+        }
+    }
+    return true;
+}
+#endif
+
+// temporary files are deleted once closed
+static void closeFiles(FILE **files)
+{
+    for (int f = 0; f < 3; f++)
+    {
+        if (files[f] != NULL)
+        {
+            fclose(files[f]);
+        }
+    }
+}
+
+/**
+ * Same contract as goi, except that the start world, the invasion times and the invasion plans are read
+ * from inputFile (positioned just after N_COLS) by the engine itself. Exits on malformed input, like
+ * main.c does.
+ */
+long long goiOutOfCore(int nThreads, int nGenerations, int nRows, int nCols, FILE *inputFile, char **line, size_t *len)
+{
+    // death toll due to fighting
+    long long deathToll = 0;
+
+    // two worlds, swapped every pass, and the invasion plans one after the other
+    FILE *files[3] = { tmpfile(), tmpfile(), tmpfile() };
+    cell_t *rowCells = malloc(sizeof(cell_t) * nCols);
+    cell_t *rings = calloc((size_t) (OOC_PASS_GENERATIONS + 1) * RING_ROWS * (nCols + 2), sizeof(cell_t));
+    cell_t *deadRow = calloc(nCols + 2, sizeof(cell_t));
+    cell_t *invRows = malloc(sizeof(cell_t) * nCols * nThreads);
+    oocWorker *workers = calloc(nThreads, sizeof(oocWorker));
+    if (files[0] == NULL || files[1] == NULL || files[2] == NULL || rowCells == NULL || rings == NULL
+        || deadRow == NULL || invRows == NULL || workers == NULL)
+    {
+        closeFiles(files);
+        free(rowCells);
+        free(rings);
+        free(deadRow);
+        free(invRows);
+        free(workers);
+        return -1;
+    }
+    int worldFd = fileno(files[0]);
+    int newWorldFd = fileno(files[1]);
+
+    int maxFaction = DEAD_FACTION;
+    if (readLayoutToFile(inputFile, line, len, worldFd, 0, nRows, nCols, rowCells, &maxFaction) == -1)
+    {
+        fprintf(stderr, "Failed to read STARTING_WORLD. Aborting...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int nInvasions;
+    if (getline(line, len, inputFile) == -1 || sscanf(*line, "%d", &nInvasions) != 1)
+    {
+        fprintf(stderr, "Failed to read N_INVASIONS. Aborting...\n");
+        exit(EXIT_FAILURE);
+    }
+    int *invasionTimes = malloc(sizeof(int) * nInvasions);
+    if (invasionTimes == NULL)
+    {
+        fprintf(stderr, "No memory for invasions. Aborting...\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nInvasions; i++)
+    {
+        if (getline(line, len, inputFile) == -1 || sscanf(*line, "%d", invasionTimes + i) != 1)
+        {
+            fprintf(stderr, "Failed to read INVASION_TIME. Aborting...\n");
+            exit(EXIT_FAILURE);
+        }
+        if (readLayoutToFile(inputFile, line, len, fileno(files[2]), i, nRows, nCols, rowCells, &maxFaction) == -1)
+        {
+            fprintf(stderr, "Failed to read INVASION_PLAN. Aborting...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    oocShared shared;
+    shared.kernel = selectRowKernel(maxFaction);
+    shared.nRows = nRows;
+    shared.nCols = nCols;
+    shared.deadRow = deadRow;
+    shared.planFd = fileno(files[2]);
+    shared.quit = false;
+    cell_t *levelRings[OOC_PASS_GENERATIONS + 1];
+    for (int level = 0; level <= OOC_PASS_GENERATIONS; level++)
+    {
+        levelRings[level] = rings + (size_t) level * RING_ROWS * (nCols + 2);
+    }
+    shared.rings = levelRings;
+    pthread_barrier_init(&shared.start, NULL, nThreads + 1);
+    pthread_barrier_init(&shared.done, NULL, nThreads + 1);
+
+    for (int t = 0; t < nThreads; t++)
+    {
+        oocWorker *worker = &workers[t];
+        worker->shared = &shared;
+        worker->tid = t;
+        worker->nThreads = nThreads;
+        worker->invRow = invRows + (size_t) t * nCols;
+        int rc = pthread_create(&worker->thread, NULL, &oocSubroutine, (void *) worker);
+        if (rc)
+        {
+            printf("Error: Return code from pthread_create() is %d\n", rc);
+            exit(-1);
+        }
+    }
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    // printing and export see every generation, so passes are a single generation long
+    int passGenerations = 1;
+    int *grid = malloc(sizeof(int) * nRows * nCols);
+    if (grid == NULL || !loadWorld(worldFd, grid, nRows, nCols, rowCells))
+    {
+        fprintf(stderr, "Error: out of memory!\n");
+        exit(EXIT_FAILURE);
+    }
+#else
+    int passGenerations = OOC_PASS_GENERATIONS;
+#endif
+
+#if PRINT_GENERATIONS
+    printf("\n=== WORLD 0 ===\n");
+    printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+    exportGeneration(grid, nRows, nCols);
+#endif
+
+    int invasionIndex = 0;
+    bool failed = false;
+    for (int generation = 0; generation < nGenerations && !failed; )
+    {
+        int nPassGenerations = nGenerations - generation < passGenerations ? nGenerations - generation : passGenerations;
+
+        // the invasion landing at each generation of the pass, if any
+        int plans[OOC_PASS_GENERATIONS + 1];
+        for (int level = 1; level <= nPassGenerations; level++)
+        {
+            plans[level] = -1;
+            if (invasionIndex < nInvasions && generation + level == invasionTimes[invasionIndex])
+            {
+                plans[level] = invasionIndex;
+                invasionIndex++;
+            }
+        }
+
+        // rows [0, computed[level]) of each generation of the pass are done
+        int computed[OOC_PASS_GENERATIONS + 1] = { 0 };
+#if STREAM_DEATHS
+        // generations of a pass finish together, so their deaths are recorded at its end
+        long long levelDeaths[OOC_PASS_GENERATIONS + 1] = { 0 };
+#endif
+        while (computed[nPassGenerations] < nRows && !failed)
+        {
+            int bandEnd = computed[0] + OOC_BAND_ROWS < nRows ? computed[0] + OOC_BAND_ROWS : nRows;
+            for (int row = computed[0]; row < bandEnd && !failed; row++)
+            {
+                failed = !readAll(worldFd, ringRow(&shared, 0, row), sizeof(cell_t) * nCols, rowOffset(nRows, nCols, 0, row));
+            }
+            computed[0] = bandEnd;
+
+            int written = computed[nPassGenerations];
+            for (int level = 1; level <= nPassGenerations && !failed; level++)
+            {
+                // a row needs the one below it, unless that is past the edge
+                int limit = computed[level - 1] == nRows ? nRows : computed[level - 1] - 1;
+                // at most a band per round, or the ring would overwrite rows the next generation still reads
+                if (limit > computed[level] + OOC_BAND_ROWS)
+                {
+                    limit = computed[level] + OOC_BAND_ROWS;
+                }
+                if (limit <= computed[level])
+                {
+                    continue;
+                }
+                shared.level = level;
+                shared.startRow = computed[level];
+                shared.endRow = limit;
+                shared.plan = plans[level];
+                pthread_barrier_wait(&shared.start);
+                pthread_barrier_wait(&shared.done);
+                for (int t = 0; t < nThreads; t++)
+                {
+                    deathToll += workers[t].deaths;
+                    failed |= workers[t].failed;
+#if STREAM_DEATHS
+                    levelDeaths[level] += workers[t].deaths;
+#endif
+                }
+                computed[level] = limit;
+            }
+
+            for (int row = written; row < computed[nPassGenerations] && !failed; row++)
+            {
+                failed = !writeAll(newWorldFd, ringRow(&shared, nPassGenerations, row), sizeof(cell_t) * nCols,
+                    rowOffset(nRows, nCols, 0, row));
+            }
+        }
+
+#if STREAM_DEATHS
+        for (int level = 1; level <= nPassGenerations && !failed; level++)
+        {
+            recordDeaths(generation + level, levelDeaths[level]);
+        }
+#endif
+
+        int tmp = worldFd;
+        worldFd = newWorldFd;
+        newWorldFd = tmp;
+        generation += nPassGenerations;
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        failed = failed || !loadWorld(worldFd, grid, nRows, nCols, rowCells);
+#endif
+
+#if PRINT_GENERATIONS
+        printf("\n=== WORLD %d ===\n", generation);
+        printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+        exportGeneration(grid, nRows, nCols);
+#endif
+    }
+    if (failed)
+    {
+        deathToll = -1;
+    }
+
+    shared.quit = true;
+    pthread_barrier_wait(&shared.start);
+    for (int t = 0; t < nThreads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&shared.start);
+    pthread_barrier_destroy(&shared.done);
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    free(grid);
+#endif
+
+    closeFiles(files);
+    free(rowCells);
+    free(rings);
+    free(deadRow);
+    free(invRows);
+    free(workers);
+    free(invasionTimes);
+
+    return deathToll;
+}
@@ -0,0 +1,13 @@
+#ifndef OUTOFCORE_H
+#define OUTOFCORE_H
+
+#include <stdio.h>
+
+// rows read from disk at a time
+#define OOC_BAND_ROWS 32
+// generations computed per pass over the world file
+#define OOC_PASS_GENERATIONS 8
+
+long long goiOutOfCore(int nThreads, int nGenerations, int nRows, int nCols, FILE *inputFile, char **line, size_t *len);
+
+#endif
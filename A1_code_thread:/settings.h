@@ -29,4 +29,136 @@
  */
 #define PRINT_GENERATIONS 0
 
+/**
+ * If set to 0, EXPORT_GENERATIONS exports JSON for the GOI visualizer.
+ * 
+ * If set to 1, EXPORT_GENERATIONS instead writes every generation as a binary PPM image, and if set to 2, as a
+ * PNG image, one after another into the export file (see frames.c). Either can be turned into a video with
+ * ffmpeg -f image2pipe -i <OPT_EXPORT_PATH>. The images are encoded on a thread of their own while the
+ * simulation goes on.
+ */
+#define EXPORT_FRAMES 0
+
+/**
+ * If set to 0, the JSON export is written as is.
+ * 
+ * If set to a non-zero value (and EXPORT_FRAMES is 0), it is gzip compressed on a thread of its own, each
+ * generation a gzip member of its own whose header records its size and generation, so that readers can seek to
+ * any generation (see frames.c). zcat <OPT_EXPORT_PATH> gives back the JSON for the GOI visualizer. Worlds with
+ * long runs of equal cells shrink by orders of magnitude.
+ */
+#define EXPORT_COMPRESSION 0
+
+/**
+ * If set to 0, cells are stored in 8 bits and the factions in a scenario must be numbered below 256.
+ * 
+ * If set to a non-zero value, cells are stored in 16 bits and factions may be numbered up to 65535,
+ * at the cost of twice the memory traffic per generation.
+ * 
+ * Either way, the cost per cell does not grow with the number of factions beyond a handful.
+ */
+#define WIDE_CELLS 0
+
+/**
+ * If set to 0, worlds are stored row-major.
+ * 
+ * If set to a non-zero value, worlds that are too big for the tiny engine are stored as square tiles in
+ * Morton order instead (see tiled.c), which keeps neighborhoods in cache for very wide worlds. All-dead
+ * tiles are not stored, so sparse worlds also take much less memory.
+ */
+#define TILED_LAYOUT 0
+
+/**
+ * If set to 0, each generation of the row-major engine is written into a second world.
+ * 
+ * If set to a non-zero value, the row-major engine updates the world in place instead, and each thread only
+ * keeps copies of the few original rows it still needs. This roughly halves the memory of the simulation.
+ */
+#define IN_PLACE_UPDATE 0
+
+/**
+ * If set to 0, every row is computed cell by cell.
+ * 
+ * If set to a non-zero value, the row-major engine looks up fixed-width row segments, together with the
+ * rows above and below them, in a table of results shared by all threads, and only computes them on a
+ * miss (see memo.c). This pays off for worlds with many identical stretches, and costs a little otherwise.
+ */
+#define MEMO_ROWS 0
+
+/**
+ * If set to 0, worlds that are too big for the tiny engine are stored whole.
+ * 
+ * If set to a non-zero value, they are stored as a hash table of their live cells instead (see hashset.c),
+ * so that time and memory follow the population rather than the size of the world. Only worth it for
+ * worlds that are almost entirely dead; this engine runs on a single thread.
+ */
+#define HASHSET_ENGINE 0
+
+/**
+ * If set to 0, main.c reads the whole scenario into memory and hands it to goi.
+ * 
+ * If set to a non-zero value, the start world and invasion plans are streamed from the input into temporary
+ * files instead, and simulated a band of rows at a time, several generations per pass over the files (see
+ * outofcore.c). This is for worlds that do not fit in memory, and is slower for all others.
+ */
+#define OUT_OF_CORE 0
+
+/**
+ * If set to 0, worlds and invasion plans are allocated on the heap.
+ * 
+ * If set to a non-zero value, the big ones are backed by 2 MB pages where the system allows it (see alloc.c),
+ * which saves TLB misses on worlds of a few MB and up. Which kind of pages were used is printed at the end.
+ */
+#define HUGE_PAGES 0
+
+/**
+ * If set to 0, buffers are allocated as the run needs them.
+ * 
+ * If set to a non-zero value, main.c plans the bytes of the whole run from the input header and maps them as
+ * one arena at startup, faulting in its pages before the simulation starts (see alloc.c). The dense engine then
+ * does no allocation of its own. The other engines still allocate as they go.
+ */
+#define ARENA_ALLOCATION 0
+
+/**
+ * If set to 0, <INPUT_PATH> is a scenario and <OUTPUT_PATH> receives its death toll.
+ * 
+ * If set to a non-zero value, <INPUT_PATH> lists scenario files, one path per line, and <OUTPUT_PATH> receives
+ * their death tolls, one per line in the same order. Small scenarios of the same dimensions and generation count
+ * are simulated 16 at a time (8 with WIDE_CELLS) in the lanes of vectors (see ensemble.c); the others run one
+ * after another, and only those are printed or exported.
+ */
+#define BATCH_RUNS 0
+
+/**
+ * If set to 0, only the final death toll is written, to <OUTPUT_PATH>.
+ * 
+ * If set to a non-zero value, and <OPT_DEATHS_PATH> is given (after <OPT_EXPORT_PATH> if EXPORT_GENERATIONS is
+ * set), each generation's deaths due to fighting are also streamed there as they happen, one
+ * "<generation> <deaths> <running total>" line per generation, written in batches by a separate thread (see
+ * deathstream.c). <OPT_DEATHS_PATH> can be a pipe. Ignored with BATCH_RUNS.
+ */
+#define STREAM_DEATHS 0
+
+/**
+ * If set to 0, deaths due to fighting are only counted.
+ * 
+ * If set to a non-zero value, every world is simulated by the tiled engine (see TILED_LAYOUT), which also
+ * attributes deaths to the invasions that caused them: the live cells each invasion lands on, and the deaths
+ * in the tiles it landed on during the ATTRIBUTION_WINDOW generations after (see attribution.h). If
+ * <OPT_ATTRIBUTION_PATH> is given (after the other optional paths that are enabled), they are written there,
+ * one "<invasion index> <invasion time> <direct> <footprint>" line per invasion. Nothing is written with
+ * OUT_OF_CORE or BATCH_RUNS.
+ */
+#define ATTRIBUTE_DEATHS 0
+
+/**
+ * If set to 0, the scheduler places goi's workers.
+ * 
+ * If set to a non-zero value, goi pins its workers to the allowed CPUs in socket, then core order, so that
+ * threads sharing a node of the barrier also share caches (see treebarrier.c). Only for runs that have the
+ * node to themselves: concurrent runs would all be pinned to the same CPUs.
+ */
+#define PIN_THREADS 0
+
 #endif
@@ -0,0 +1,1019 @@
+/**
+ * Engine that stores the world as square tiles of TILE_SIZE x TILE_SIZE cells, each contiguous in
+ * memory, laid out in Morton (Z-order) of their tile coordinates. Enabled by TILED_LAYOUT.
+ *
+ * With row-major storage, the three rows a kernel reads are a whole world width apart, which for very
+ * wide worlds no longer fits in the caches. Here a tile and its neighbors are a few KB, and tiles that
+ * are close in the world are mostly close in memory too. Each tile is stepped by copying it and a
+ * one-cell halo from its neighbors into a small padded scratch grid, on which the usual row kernel
+ * runs. Workers take contiguous runs of tiles in Morton order.
+ *
+ * Tiles that are all dead are not allocated (see deadTile), and only tiles next to live ones are stepped,
+ * so a huge world with scattered colonies only costs memory and time for the area around them. Tiles come
+ * from a pool that grows in chunks and takes back tiles that die out.
+ *
+ * Every tile also records whether it is empty, holds a single faction or several (see tileKind). Fighting
+ * only happens where factions meet, so a tile whose neighborhood holds one faction runs plain Life
+ * (stepRowOneFaction), and only tiles on the fronts run the full kernel. An empty tile whose halo is dead
+ * too is not stepped at all.
+ *
+ * Settled regions are mostly still lifes and oscillators of period 2 or 3. Each tile keeps a hash of its
+ * last few generations (see tileRecord). When the tile and its 8 neighbors are what they were some period
+ * ago, the tile's next generation is the one that followed back then, so it is replayed (frozen) instead
+ * of stepped, deaths included. This is checked anew every generation, so a tile thaws as soon as anything
+ * around it changes. Hashes can collide, so a match is confirmed against the cells of the neighborhood
+ * before replaying; the worlds of the last MAX_PERIOD + 1 generations are kept for this, and to copy the
+ * replayed tile from.
+ *
+ * Conversion from and to row-major only happens at the boundaries: loading the start world and
+ * invasion plans, and printing or exporting generations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "util.h"
+#include "frames.h"
+#include "settings.h"
+#include "goi.h"
+#include "kernel.h"
+#include "tiled.h"
+#include "deathstream.h"
+#include "attribution.h"
+
+#define TILE_CELLS (TILE_SIZE * TILE_SIZE)
+#define SCRATCH_SIZE (TILE_SIZE + 2)
+
+typedef struct tileLayoutStruct {
+    int nRows;
+    int nCols;
+    int tilesDown;
+    int tilesAcross;
+    int nTiles;
+    // storage slot of the tile at (tileRow, tileCol), indexed by tileRow * tilesAcross + tileCol
+    int *slotOf;
+    // inverse of slotOf
+    int *tileAt;
+} tileLayout;
+
+/**
+ * All-dead tiles are not stored: they all point at deadTile, which is never written to. Tiles outside of
+ * the world are dead too.
+ */
+static cell_t deadTile[TILE_CELLS];
+
+// tiles are allocated this many at a time
+#define TILES_PER_CHUNK 64
+
+/**
+ * Tiles that are not in use, handed out again before allocating more. Only goiTiled touches the pool,
+ * between generations, so it needs no locking.
+ */
+typedef struct tilePoolStruct {
+    cell_t **spare;
+    int nSpare;
+    cell_t **chunks;
+    int nChunks;
+} tilePool;
+
+/**
+ * What a tile holds: TILE_EMPTY, the dense id of its only faction, or TILE_MIXED.
+ */
+#define TILE_EMPTY DEAD_FACTION
+#define TILE_MIXED -1
+
+/**
+ * A world as the storage slot of each tile (see tileLayout), the kind of each slot, and the slots that
+ * are allocated.
+ */
+typedef struct tileMapStruct {
+    cell_t **tiles;
+    int *kinds;
+    int *allocated;
+    int nAllocated;
+} tileMap;
+
+// the longest period of the oscillators frozen; the worlds of that many generations are kept
+#define MAX_PERIOD 3
+// generations of tileRecord kept per tile: MAX_PERIOD back, the current and the next one
+#define HISTORY_LENGTH (MAX_PERIOD + 2)
+// the worlds of MAX_PERIOD + 1 generations, the next one and an invasion plan
+#define N_TILE_MAPS (MAX_PERIOD + 3)
+
+/**
+ * What a tile was at some generation. Dead tiles that were not stepped have no record, and their hash
+ * is 0, as is that of any all-dead tile.
+ */
+typedef struct tileRecordStruct {
+    int generation;
+    uint64_t hash;
+    int kind;
+    // deaths due to fighting while computing this generation of the tile, and whether an invasion
+    // landed on it then
+    int deaths;
+    bool invaded;
+} tileRecord;
+
+typedef struct tiledSharedStruct {
+    const tileLayout *layout;
+    rowKernel kernel;
+    // the generation being computed
+    int generation;
+    // records of generation % HISTORY_LENGTH of the slot at slot * HISTORY_LENGTH
+    tileRecord *history;
+    // past[k] is the world of k generations before the one being computed from, and past[0] is world
+    const tileMap *past[MAX_PERIOD + 1];
+    const tileMap *world;
+    // NULL unless an invasion lands this generation
+    const tileMap *inv;
+    // the slots stepped this generation in Morton order, the tiles their next states are written to,
+    // and the kinds those came out as
+    const int *active;
+    cell_t **out;
+    int *kinds;
+#if ATTRIBUTE_DEATHS
+    // the deaths due to fighting of each active tile, for goiTiled to attribute to invasions
+    int *deaths;
+#endif
+    int nGenerations;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+} tiledShared;
+
+typedef struct tiledWorkerStruct {
+    tiledShared *shared;
+    pthread_t thread;
+    // the run of active tiles this worker steps this generation
+    int startIndex;
+    int endIndex;
+    cell_t scratch[SCRATCH_SIZE * SCRATCH_SIZE];
+    long long deaths;
+} tiledWorker;
+
+static uint32_t spreadBits(uint32_t x)
+{
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static uint32_t mortonCode(int tileRow, int tileCol)
+{
+    return (spreadBits(tileRow) << 1) | spreadBits(tileCol);
+}
+
+static const tileLayout *sortingLayout;
+
+static int compareMorton(const void *a, const void *b)
+{
+    int tileA = *(const int *) a;
+    int tileB = *(const int *) b;
+    uint32_t codeA = mortonCode(tileA / sortingLayout->tilesAcross, tileA % sortingLayout->tilesAcross);
+    uint32_t codeB = mortonCode(tileB / sortingLayout->tilesAcross, tileB % sortingLayout->tilesAcross);
+    return codeA < codeB ? -1 : codeA > codeB;
+}
+
+static int initTileLayout(tileLayout *layout, int nRows, int nCols)
+{
+    layout->nRows = nRows;
+    layout->nCols = nCols;
+    layout->tilesDown = (nRows + TILE_SIZE - 1) / TILE_SIZE;
+    layout->tilesAcross = (nCols + TILE_SIZE - 1) / TILE_SIZE;
+    layout->nTiles = layout->tilesDown * layout->tilesAcross;
+    layout->slotOf = malloc(sizeof(int) * layout->nTiles);
+    layout->tileAt = malloc(sizeof(int) * layout->nTiles);
+    if (layout->slotOf == NULL || layout->tileAt == NULL)
+    {
+        free(layout->slotOf);
+        free(layout->tileAt);
+        return -1;
+    }
+
+    for (int tile = 0; tile < layout->nTiles; tile++)
+    {
+        layout->tileAt[tile] = tile;
+    }
+    sortingLayout = layout;
+    qsort(layout->tileAt, layout->nTiles, sizeof(int), compareMorton);
+    for (int slot = 0; slot < layout->nTiles; slot++)
+    {
+        layout->slotOf[layout->tileAt[slot]] = slot;
+    }
+    return 0;
+}
+
+static void freeTileLayout(tileLayout *layout)
+{
+    free(layout->slotOf);
+    free(layout->tileAt);
+}
+
+/**
+ * Returns an all-dead tile. Exits if out of memory, since workers may be waiting on it.
+ */
+static cell_t *popTile(tilePool *pool)
+{
+    if (pool->nSpare == 0)
+    {
+        cell_t *chunk = malloc(sizeof(cell_t) * TILE_CELLS * TILES_PER_CHUNK);
+        cell_t **chunks = realloc(pool->chunks, sizeof(cell_t *) * (pool->nChunks + 1));
+        cell_t **spare = chunks != NULL ? realloc(pool->spare, sizeof(cell_t *) * (pool->nChunks + 1) * TILES_PER_CHUNK) : NULL;
+        if (chunk == NULL || chunks == NULL || spare == NULL)
+        {
+            printf("ERROR\n");
+            exit(-1);
+        }
+        pool->chunks = chunks;
+        pool->spare = spare;
+        pool->chunks[pool->nChunks++] = chunk;
+        for (int t = 0; t < TILES_PER_CHUNK; t++)
+        {
+            pool->spare[pool->nSpare++] = chunk + (size_t) t * TILE_CELLS;
+        }
+    }
+    cell_t *tile = pool->spare[--pool->nSpare];
+    memset(tile, 0, sizeof(cell_t) * TILE_CELLS);
+    return tile;
+}
+
+static void pushTile(tilePool *pool, cell_t *tile)
+{
+    pool->spare[pool->nSpare++] = tile;
+}
+
+static void freeTilePool(tilePool *pool)
+{
+    for (int c = 0; c < pool->nChunks; c++)
+    {
+        free(pool->chunks[c]);
+    }
+    free(pool->chunks);
+    free(pool->spare);
+}
+
+static int initTileMap(tileMap *map, int nTiles)
+{
+    map->tiles = malloc(sizeof(cell_t *) * nTiles);
+    map->kinds = malloc(sizeof(int) * nTiles);
+    map->allocated = malloc(sizeof(int) * nTiles);
+    map->nAllocated = 0;
+    if (map->tiles == NULL || map->kinds == NULL || map->allocated == NULL)
+    {
+        free(map->tiles);
+        free(map->kinds);
+        free(map->allocated);
+        map->tiles = NULL;
+        map->kinds = NULL;
+        map->allocated = NULL;
+        return -1;
+    }
+    for (int slot = 0; slot < nTiles; slot++)
+    {
+        map->tiles[slot] = deadTile;
+        map->kinds[slot] = TILE_EMPTY;
+    }
+    return 0;
+}
+
+static void freeTileMap(tileMap *map)
+{
+    free(map->tiles);
+    free(map->kinds);
+    free(map->allocated);
+}
+
+/**
+ * Returns the kind of a tile holding what tiles of kinds a and b hold together.
+ */
+static int mergeKinds(int a, int b)
+{
+    if (a == TILE_EMPTY || a == b)
+    {
+        return b;
+    }
+    return b == TILE_EMPTY ? a : TILE_MIXED;
+}
+
+/**
+ * Releases the tile in slot, which must be allocated but need not be listed in map->allocated.
+ */
+static void releaseTile(tileMap *map, tilePool *pool, int slot)
+{
+    pushTile(pool, map->tiles[slot]);
+    map->tiles[slot] = deadTile;
+    map->kinds[slot] = TILE_EMPTY;
+}
+
+/**
+ * Returns the tile in slot, allocating it if it was dead.
+ */
+static cell_t *touchTile(tileMap *map, tilePool *pool, int slot)
+{
+    if (map->tiles[slot] == deadTile)
+    {
+        map->tiles[slot] = popTile(pool);
+        map->allocated[map->nAllocated++] = slot;
+    }
+    return map->tiles[slot];
+}
+
+/**
+ * Returns every allocated tile of map to the pool.
+ */
+static void clearTileMap(tileMap *map, tilePool *pool)
+{
+    for (int a = 0; a < map->nAllocated; a++)
+    {
+        releaseTile(map, pool, map->allocated[a]);
+    }
+    map->nAllocated = 0;
+}
+
+/**
+ * Returns the cells of the tile at (tileRow, tileCol), deadTile if it is dead or outside of the world.
+ */
+static const cell_t *tileCells(const tileLayout *layout, const tileMap *map, int tileRow, int tileCol)
+{
+    if (tileRow < 0 || tileRow >= layout->tilesDown || tileCol < 0 || tileCol >= layout->tilesAcross)
+    {
+        return deadTile;
+    }
+    return map->tiles[layout->slotOf[tileRow * layout->tilesAcross + tileCol]];
+}
+
+/**
+ * Returns the kind of what the tile at (tileRow, tileCol) and its 8 neighbors hold together.
+ */
+static int neighborhoodKind(const tileLayout *layout, const tileMap *map, int tileRow, int tileCol)
+{
+    int kind = TILE_EMPTY;
+    for (int r = tileRow - 1; r <= tileRow + 1; r++)
+    {
+        for (int c = tileCol - 1; c <= tileCol + 1; c++)
+        {
+            if (r >= 0 && r < layout->tilesDown && c >= 0 && c < layout->tilesAcross)
+            {
+                kind = mergeKinds(kind, map->kinds[layout->slotOf[r * layout->tilesAcross + c]]);
+            }
+        }
+    }
+    return kind;
+}
+
+/**
+ * Copies the live cells of grid into the (all-dead) tiled, translating factions to dense ids. Only the
+ * tiles they fall in are allocated.
+ */
+static void packTiled(const tileLayout *layout, const int *grid, tileMap *tiled, tilePool *pool, const factionMap *map)
+{
+    for (int row = 0; row < layout->nRows; row++)
+    {
+        for (int col = 0; col < layout->nCols; col++)
+        {
+            int faction = getValueAt(grid, layout->nRows, layout->nCols, row, col);
+            if (faction > DEAD_FACTION && faction < MAX_FACTIONS)
+            {
+                int slot = layout->slotOf[(row / TILE_SIZE) * layout->tilesAcross + col / TILE_SIZE];
+                cell_t *tile = touchTile(tiled, pool, slot);
+                tile[(row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE] = map->toDense[faction];
+                tiled->kinds[slot] = mergeKinds(tiled->kinds[slot], map->toDense[faction]);
+            }
+        }
+    }
+}
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+static void unpackTiled(const tileLayout *layout, const tileMap *tiled, int *grid, const factionMap *map)
+{
+    for (int row = 0; row < layout->nRows; row++)
+    {
+        for (int col = 0; col < layout->nCols; col++)
+        {
+            const cell_t *tile = tileCells(layout, tiled, row / TILE_SIZE, col / TILE_SIZE);
+            cell_t cell = tile[(row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE];
+            setValueAt(grid, layout->nRows, layout->nCols, row, col, map->toFaction[cell]);
+        }
+    }
+}
+#endif
+
+/**
+ * Copies the tile at (tileRow, tileCol) of world and the cells around it into the padded scratch grid.
+ */
+static void gatherTile(const tileLayout *layout, const tileMap *world, int tileRow, int tileCol, cell_t *scratch)
+{
+    const cell_t *around[3][3];
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            around[dy + 1][dx + 1] = tileCells(layout, world, tileRow + dy, tileCol + dx);
+        }
+    }
+
+    const cell_t *left = around[1][0];
+    const cell_t *right = around[1][2];
+    const cell_t *tile = around[1][1];
+
+    // corners
+    scratch[0] = around[0][0][TILE_CELLS - 1];
+    scratch[SCRATCH_SIZE - 1] = around[0][2][TILE_CELLS - TILE_SIZE];
+    scratch[(SCRATCH_SIZE - 1) * SCRATCH_SIZE] = around[2][0][TILE_SIZE - 1];
+    scratch[SCRATCH_SIZE * SCRATCH_SIZE - 1] = around[2][2][0];
+
+    // top and bottom edges
+    memcpy(scratch + 1, around[0][1] + TILE_CELLS - TILE_SIZE, TILE_SIZE * sizeof(cell_t));
+    memcpy(scratch + (SCRATCH_SIZE - 1) * SCRATCH_SIZE + 1, around[2][1], TILE_SIZE * sizeof(cell_t));
+
+    // the tile itself, with the left and right edges
+    for (int row = 0; row < TILE_SIZE; row++)
+    {
+        cell_t *out = scratch + (row + 1) * SCRATCH_SIZE;
+        out[0] = left[row * TILE_SIZE + TILE_SIZE - 1];
+        memcpy(out + 1, tile + row * TILE_SIZE, TILE_SIZE * sizeof(cell_t));
+        out[TILE_SIZE + 1] = right[row * TILE_SIZE];
+    }
+}
+
+/**
+ * Returns a hash of the cells of tile, 0 if they are all dead.
+ */
+static uint64_t hashTile(const cell_t *tile)
+{
+    uint64_t hash = 0;
+    for (size_t offset = 0; offset < sizeof(cell_t) * TILE_CELLS; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, (const char *) tile + offset, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/**
+ * Returns the record of slot at generation, NULL if the tile was not stepped then (and so was dead).
+ */
+static tileRecord *recordOf(tileRecord *history, int slot, int generation)
+{
+    tileRecord *record = &history[(size_t) slot * HISTORY_LENGTH + generation % HISTORY_LENGTH];
+    return record->generation == generation ? record : NULL;
+}
+
+static void setRecord(tileRecord *history, int slot, int generation, uint64_t hash, int kind, int deaths, bool invaded)
+{
+    tileRecord *record = &history[(size_t) slot * HISTORY_LENGTH + generation % HISTORY_LENGTH];
+    record->generation = generation;
+    record->hash = hash;
+    record->kind = kind;
+    record->deaths = deaths;
+    record->invaded = invaded;
+}
+
+static uint64_t hashAt(tileRecord *history, int slot, int generation)
+{
+    const tileRecord *record = recordOf(history, slot, generation);
+    return record != NULL ? record->hash : 0;
+}
+
+/**
+ * Returns whether the tile at (tileRow, tileCol) and its 8 neighbors hold the same cells in the world
+ * being computed from as period generations before it.
+ */
+static bool neighborhoodMatches(const tiledShared *shared, int tileRow, int tileCol, int period)
+{
+    const tileLayout *layout = shared->layout;
+    for (int r = tileRow - 1; r <= tileRow + 1; r++)
+    {
+        for (int c = tileCol - 1; c <= tileCol + 1; c++)
+        {
+            if (r < 0 || r >= layout->tilesDown || c < 0 || c >= layout->tilesAcross)
+            {
+                continue;
+            }
+            int slot = layout->slotOf[r * layout->tilesAcross + c];
+            const cell_t *now = shared->past[0]->tiles[slot];
+            const cell_t *then = shared->past[period]->tiles[slot];
+            if (now != then && memcmp(now, then, sizeof(cell_t) * TILE_CELLS) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the shortest period, up to MAX_PERIOD, with which the tile at (tileRow, tileCol) and its 8
+ * neighbors repeat in the world being computed from, or 0 if they do not. Hashes pick the candidates,
+ * and the cells confirm them.
+ */
+static int neighborhoodPeriod(const tiledShared *shared, int tileRow, int tileCol)
+{
+    const tileLayout *layout = shared->layout;
+    int generation = shared->generation - 1;
+    for (int period = 1; period <= MAX_PERIOD && period <= generation; period++)
+    {
+        bool repeats = true;
+        for (int r = tileRow - 1; r <= tileRow + 1 && repeats; r++)
+        {
+            for (int c = tileCol - 1; c <= tileCol + 1 && repeats; c++)
+            {
+                if (r >= 0 && r < layout->tilesDown && c >= 0 && c < layout->tilesAcross)
+                {
+                    int slot = layout->slotOf[r * layout->tilesAcross + c];
+                    repeats = hashAt(shared->history, slot, generation) == hashAt(shared->history, slot, generation - period);
+                }
+            }
+        }
+        if (repeats && neighborhoodMatches(shared, tileRow, tileCol, period))
+        {
+            return period;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns whether the one-cell border of the padded scratch grid is all dead.
+ */
+static bool isHaloDead(const cell_t *scratch)
+{
+    for (int i = 0; i < SCRATCH_SIZE; i++)
+    {
+        if (scratch[i] != DEAD_FACTION || scratch[(SCRATCH_SIZE - 1) * SCRATCH_SIZE + i] != DEAD_FACTION
+            || scratch[i * SCRATCH_SIZE] != DEAD_FACTION || scratch[i * SCRATCH_SIZE + SCRATCH_SIZE - 1] != DEAD_FACTION)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Steps the index-th active tile from shared->world into shared->out[index], with the cheapest kernel
+ * for what its neighborhood holds, and records the kind it comes out as; returns the deaths due to
+ * fighting.
+ */
+static int stepTile(const tiledShared *shared, int index, cell_t *scratch)
+{
+    const tileLayout *layout = shared->layout;
+    int slot = shared->active[index];
+    int tile = layout->tileAt[slot];
+    int tileRow = tile / layout->tilesAcross;
+    int tileCol = tile % layout->tilesAcross;
+
+    // edge tiles only partly cover the world
+    int height = layout->nRows - tileRow * TILE_SIZE < TILE_SIZE ? layout->nRows - tileRow * TILE_SIZE : TILE_SIZE;
+    int width = layout->nCols - tileCol * TILE_SIZE < TILE_SIZE ? layout->nCols - tileCol * TILE_SIZE : TILE_SIZE;
+
+    const cell_t *inv = shared->inv != NULL && shared->inv->tiles[slot] != deadTile ? shared->inv->tiles[slot] : NULL;
+    cell_t *out = shared->out[index];
+    int period = inv == NULL ? neighborhoodPeriod(shared, tileRow, tileCol) : 0;
+    const tileRecord *replayed = period != 0 ? recordOf(shared->history, slot, shared->generation - period) : NULL;
+    // replaying a generation an invasion landed on would land it again
+    if (period != 0 && (replayed == NULL || !replayed->invaded))
+    {
+        memcpy(out, shared->past[period - 1]->tiles[slot], sizeof(cell_t) * TILE_CELLS);
+        int kind = replayed != NULL ? replayed->kind : TILE_EMPTY;
+        int deaths = replayed != NULL ? replayed->deaths : 0;
+        shared->kinds[index] = kind;
+        setRecord(shared->history, slot, shared->generation, replayed != NULL ? replayed->hash : 0, kind, deaths, false);
+        return deaths;
+    }
+
+    gatherTile(layout, shared->world, tileRow, tileCol, scratch);
+    if (inv == NULL && shared->world->kinds[slot] == TILE_EMPTY && isHaloDead(scratch))
+    {
+        // stays dead, whatever out holds is discarded
+        shared->kinds[index] = TILE_EMPTY;
+        setRecord(shared->history, slot, shared->generation, 0, TILE_EMPTY, 0, false);
+        return 0;
+    }
+
+    // invasions can bring in any faction, and landing on a cell counts as a death, so they take the full kernel
+    int kind = inv == NULL ? neighborhoodKind(layout, shared->world, tileRow, tileCol) : TILE_MIXED;
+    int deaths = 0;
+    int outKind = TILE_EMPTY;
+    for (int row = 0; row < height; row++)
+    {
+        const cell_t *above = scratch + row * SCRATCH_SIZE + 1;
+        const cell_t *middle = scratch + (row + 1) * SCRATCH_SIZE + 1;
+        const cell_t *below = scratch + (row + 2) * SCRATCH_SIZE + 1;
+        cell_t *outRow = out + row * TILE_SIZE;
+        int firstLive = width;
+        int lastLive = -1;
+        if (kind != TILE_MIXED)
+        {
+            stepRowOneFaction(kind, above, middle, below, outRow, 0, width, &firstLive, &lastLive);
+            outKind = lastLive >= 0 ? kind : outKind;
+            continue;
+        }
+
+        deaths += shared->kernel(above, middle, below, inv != NULL ? inv + row * TILE_SIZE : NULL,
+            outRow, 0, width, &firstLive, &lastLive);
+        for (int col = firstLive; col <= lastLive && outKind != TILE_MIXED; col++)
+        {
+            outKind = mergeKinds(outKind, outRow[col]);
+        }
+    }
+    shared->kinds[index] = outKind;
+    setRecord(shared->history, slot, shared->generation, outKind != TILE_EMPTY ? hashTile(out) : 0, outKind, deaths,
+        inv != NULL);
+    return deaths;
+}
+
+static void *tiledSubroutine(void *arg)
+{
+    tiledWorker *worker = (tiledWorker *) arg;
+    tiledShared *shared = worker->shared;
+
+    for (int k = 1; k <= shared->nGenerations; k++)
+    {
+        // wait for goiTiled to set up this generation
+        pthread_barrier_wait(&shared->start);
+
+        long long deaths = 0;
+        for (int index = worker->startIndex; index < worker->endIndex; index++)
+        {
+#if ATTRIBUTE_DEATHS
+            shared->deaths[index] = stepTile(shared, index, worker->scratch);
+            deaths += shared->deaths[index];
+#else
+            deaths += stepTile(shared, index, worker->scratch);
+#endif
+        }
+        worker->deaths = deaths;
+
+        pthread_barrier_wait(&shared->done);
+    }
+    return NULL;
+}
+
+static int compareSlots(const void *a, const void *b)
+{
+    int slotA = *(const int *) a;
+    int slotB = *(const int *) b;
+    return slotA < slotB ? -1 : slotA > slotB;
+}
+
+/**
+ * Lists the slots that can hold live cells next generation into active, in Morton order, and returns how
+ * many there are: the allocated tiles of world and their neighbors, and the tiles inv (can be NULL) lands
+ * on. stamp holds the last generation each slot was listed in.
+ */
+static int listActiveTiles(const tileLayout *layout, const tileMap *world, const tileMap *inv, int generation,
+    int *stamp, int *active)
+{
+    int nActive = 0;
+    for (int a = 0; a < world->nAllocated; a++)
+    {
+        int tile = layout->tileAt[world->allocated[a]];
+        int tileRow = tile / layout->tilesAcross;
+        int tileCol = tile % layout->tilesAcross;
+        for (int r = tileRow - 1; r <= tileRow + 1; r++)
+        {
+            for (int c = tileCol - 1; c <= tileCol + 1; c++)
+            {
+                if (r < 0 || r >= layout->tilesDown || c < 0 || c >= layout->tilesAcross)
+                {
+                    continue;
+                }
+                int slot = layout->slotOf[r * layout->tilesAcross + c];
+                if (stamp[slot] != generation)
+                {
+                    stamp[slot] = generation;
+                    active[nActive++] = slot;
+                }
+            }
+        }
+    }
+    for (int a = 0; inv != NULL && a < inv->nAllocated; a++)
+    {
+        int slot = inv->allocated[a];
+        if (stamp[slot] != generation)
+        {
+            stamp[slot] = generation;
+            active[nActive++] = slot;
+        }
+    }
+    qsort(active, nActive, sizeof(int), compareSlots);
+    return nActive;
+}
+
+/**
+ * Same contract as goi, on the tiled layout.
+ *
+ * Only tiles with live cells are allocated. Each generation, the tiles that can hold live cells afterwards
+ * are listed and split between the workers; tiles of the next world that come out all dead go back to
+ * the pool.
+ *
+ * With ATTRIBUTE_DEATHS set, each tile is also tagged with the last invasion that landed on it. The live
+ * cells an invasion lands on are counted as it lands, and for ATTRIBUTION_WINDOW generations after that,
+ * the deaths of the tiles still tagged with it are attributed to it as well (see attribution.h).
+ */
+long long goiTiled(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans)
+{
+    // death toll due to fighting
+    long long deathToll = 0;
+
+    factionMap map;
+    buildFactionMap(&map, startWorld, nRows, nCols, nInvasions, invasionPlans);
+
+    tileLayout layout;
+    if (initTileLayout(&layout, nRows, nCols) == -1)
+    {
+        return -1;
+    }
+
+    tilePool pool = { NULL, 0, NULL, 0 };
+    // past[k] is the world of k generations ago, world being past[0]; invasion plans are packed into inv in
+    // turn, as they land; newWorld holds the world of MAX_PERIOD + 1 generations ago until it is overwritten
+    tileMap maps[N_TILE_MAPS];
+    tileMap *past[MAX_PERIOD + 1];
+    for (int k = 0; k <= MAX_PERIOD; k++)
+    {
+        past[k] = &maps[k];
+    }
+    tileMap *world = past[0];
+    tileMap *newWorld = &maps[MAX_PERIOD + 1];
+    tileMap *inv = &maps[MAX_PERIOD + 2];
+    int mapsReady = 0;
+    while (mapsReady < N_TILE_MAPS && initTileMap(&maps[mapsReady], layout.nTiles) == 0)
+    {
+        mapsReady++;
+    }
+    int *stamp = malloc(sizeof(int) * layout.nTiles);
+    int *active = malloc(sizeof(int) * layout.nTiles);
+    cell_t **out = malloc(sizeof(cell_t *) * layout.nTiles);
+    int *kinds = malloc(sizeof(int) * layout.nTiles);
+    tiledWorker *workers = malloc(sizeof(tiledWorker) * nThreads);
+    tileRecord *history = malloc(sizeof(tileRecord) * HISTORY_LENGTH * layout.nTiles);
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    // worlds are printed and exported with their original factions
+    int *grid = malloc(sizeof(int) * nRows * nCols);
+    bool gridReady = grid != NULL;
+#else
+    bool gridReady = true;
+#endif
+#if ATTRIBUTE_DEATHS
+    // the invasion that last landed on each slot, or -1
+    int *tags = malloc(sizeof(int) * layout.nTiles);
+    int *tileDeaths = malloc(sizeof(int) * layout.nTiles);
+    invasionDeaths *attributed = calloc(nInvasions > 0 ? nInvasions : 1, sizeof(invasionDeaths));
+    bool attributionReady = tags != NULL && tileDeaths != NULL && attributed != NULL;
+#else
+    bool attributionReady = true;
+#endif
+    if (mapsReady < N_TILE_MAPS || stamp == NULL || active == NULL || out == NULL || kinds == NULL || workers == NULL
+        || history == NULL || !gridReady || !attributionReady)
+    {
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        free(grid);
+#endif
+#if ATTRIBUTE_DEATHS
+        free(tags);
+        free(tileDeaths);
+        free(attributed);
+#endif
+        for (int m = 0; m < mapsReady; m++)
+        {
+            freeTileMap(&maps[m]);
+        }
+        free(stamp);
+        free(active);
+        free(out);
+        free(kinds);
+        free(workers);
+        free(history);
+        freeTileLayout(&layout);
+        return -1;
+    }
+    for (int slot = 0; slot < layout.nTiles; slot++)
+    {
+        stamp[slot] = 0;
+        for (int h = 0; h < HISTORY_LENGTH; h++)
+        {
+            history[(size_t) slot * HISTORY_LENGTH + h].generation = -1;
+        }
+#if ATTRIBUTE_DEATHS
+        tags[slot] = -1;
+#endif
+    }
+    packTiled(&layout, startWorld, world, &pool, &map);
+    for (int a = 0; a < world->nAllocated; a++)
+    {
+        int slot = world->allocated[a];
+        setRecord(history, slot, 0, hashTile(world->tiles[slot]), world->kinds[slot], 0, false);
+    }
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    unpackTiled(&layout, world, grid, &map);
+#endif
+
+#if PRINT_GENERATIONS
+    printf("\n=== WORLD 0 ===\n");
+    printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+    exportGeneration(grid, nRows, nCols);
+#endif
+
+    tiledShared shared;
+    shared.layout = &layout;
+    shared.kernel = selectRowKernel(map.nFactions);
+    shared.active = active;
+    shared.out = out;
+    shared.kinds = kinds;
+    shared.history = history;
+#if ATTRIBUTE_DEATHS
+    shared.deaths = tileDeaths;
+#endif
+    shared.nGenerations = nGenerations;
+    pthread_barrier_init(&shared.start, NULL, nThreads + 1);
+    pthread_barrier_init(&shared.done, NULL, nThreads + 1);
+
+    for (int t = 0; t < nThreads; t++)
+    {
+        tiledWorker *worker = &workers[t];
+        worker->shared = &shared;
+        int rc = pthread_create(&worker->thread, NULL, &tiledSubroutine, (void *) worker);
+        if (rc)
+        {
+            printf("Error: Return code from pthread_create() is %d\n", rc);
+            exit(-1);
+        }
+    }
+
+    int invasionIndex = 0;
+    for (int i = 1; i <= nGenerations; i++)
+    {
+        // is there an invasion this generation?
+        shared.inv = NULL;
+        if (invasionIndex < nInvasions && i == invasionTimes[invasionIndex])
+        {
+            packTiled(&layout, invasionPlans[invasionIndex], inv, &pool, &map);
+            shared.inv = inv;
+#if ATTRIBUTE_DEATHS
+            // landing on a live cell kills it
+            for (int a = 0; a < inv->nAllocated; a++)
+            {
+                int slot = inv->allocated[a];
+                const cell_t *landing = inv->tiles[slot];
+                const cell_t *landedOn = world->tiles[slot];
+                for (int c = 0; c < TILE_CELLS && landedOn != deadTile; c++)
+                {
+                    attributed[invasionIndex].direct += landing[c] != DEAD_FACTION && landedOn[c] != DEAD_FACTION;
+                }
+                tags[slot] = invasionIndex;
+            }
+#endif
+            invasionIndex++;
+        }
+
+        int nActive = listActiveTiles(&layout, world, shared.inv, i, stamp, active);
+
+        // tiles newWorld still holds from MAX_PERIOD + 1 generations ago are reused where they are stepped
+        // again, and freed elsewhere
+        int kept = 0;
+        for (int a = 0; a < newWorld->nAllocated; a++)
+        {
+            int slot = newWorld->allocated[a];
+            if (stamp[slot] == i)
+            {
+                newWorld->allocated[kept++] = slot;
+            }
+            else
+            {
+                releaseTile(newWorld, &pool, slot);
+            }
+        }
+        newWorld->nAllocated = kept;
+        for (int index = 0; index < nActive; index++)
+        {
+            out[index] = touchTile(newWorld, &pool, active[index]);
+        }
+
+        shared.generation = i;
+        shared.world = world;
+        for (int k = 0; k <= MAX_PERIOD; k++)
+        {
+            shared.past[k] = past[k];
+        }
+        for (int t = 0; t < nThreads; t++)
+        {
+            workers[t].startIndex = (int) ((long) nActive * t / nThreads);
+            workers[t].endIndex = (int) ((long) nActive * (t + 1) / nThreads);
+        }
+
+        pthread_barrier_wait(&shared.start);
+        pthread_barrier_wait(&shared.done);
+
+        long long deaths = 0;
+        for (int t = 0; t < nThreads; t++)
+        {
+            deaths += workers[t].deaths;
+        }
+        deathToll += deaths;
+#if STREAM_DEATHS
+        recordDeaths(i, deaths);
+#endif
+
+#if ATTRIBUTE_DEATHS
+        // invasions land in order, so if the last one is out of its window, all are
+        if (ATTRIBUTION_WINDOW > 0 && invasionIndex > 0 && i - invasionTimes[invasionIndex - 1] <= ATTRIBUTION_WINDOW)
+        {
+            for (int index = 0; index < nActive; index++)
+            {
+                int tag = tags[active[index]];
+                int age = tag >= 0 ? i - invasionTimes[tag] : 0;
+                // the generation an invasion lands on is computed from the world it has not yet touched
+                if (age >= 1 && age <= ATTRIBUTION_WINDOW)
+                {
+                    attributed[tag].footprint += tileDeaths[index];
+                }
+            }
+        }
+#endif
+
+        // tiles that came out all dead go back to the pool
+        newWorld->nAllocated = 0;
+        for (int index = 0; index < nActive; index++)
+        {
+            int slot = active[index];
+            if (kinds[index] != TILE_EMPTY)
+            {
+                newWorld->allocated[newWorld->nAllocated++] = slot;
+                newWorld->kinds[slot] = kinds[index];
+            }
+            else
+            {
+                releaseTile(newWorld, &pool, slot);
+            }
+        }
+        if (shared.inv != NULL)
+        {
+            clearTileMap(inv, &pool);
+        }
+
+        tileMap *oldest = past[MAX_PERIOD];
+        for (int k = MAX_PERIOD; k > 0; k--)
+        {
+            past[k] = past[k - 1];
+        }
+        past[0] = newWorld;
+        world = newWorld;
+        newWorld = oldest;
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        unpackTiled(&layout, world, grid, &map);
+#endif
+
+#if PRINT_GENERATIONS
+        printf("\n=== WORLD %d ===\n", i);
+        printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+        exportGeneration(grid, nRows, nCols);
+#endif
+    }
+
+    for (int t = 0; t < nThreads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&shared.start);
+    pthread_barrier_destroy(&shared.done);
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    free(grid);
+#endif
+    for (int m = 0; m < N_TILE_MAPS; m++)
+    {
+        freeTileMap(&maps[m]);
+    }
+    freeTilePool(&pool);
+    free(stamp);
+    free(active);
+    free(out);
+    free(kinds);
+    free(workers);
+    free(history);
+    freeTileLayout(&layout);
+#if ATTRIBUTE_DEATHS
+    reportAttribution(attributed, nInvasions, invasionTimes);
+    free(tags);
+    free(tileDeaths);
+    free(attributed);
+#endif
+
+    return deathToll;
+}
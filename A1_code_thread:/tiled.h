@@ -0,0 +1,9 @@
+#ifndef TILED_H
+#define TILED_H
+
+// side of the square tiles of the tiled engine, in cells
+#define TILE_SIZE 32
+
+long long goiTiled(int nThreads, int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans);
+
+#endif
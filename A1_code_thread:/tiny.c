@@ -0,0 +1,246 @@
+/**
+ * Single-threaded engine for tiny worlds (see TINY_MAX_ROWS and TINY_MAX_COLS).
+ *
+ * For worlds this small, the cost of the threaded engine is all overhead: thread creation, barriers
+ * and mallocs. Here every faction is kept as a bit plane with one 64-bit word per row, so the whole
+ * world lives in a few cache lines and each generation is a short run of word-wide bit operations.
+ *
+ * The rules of isBirthable, isSurvivable and willFight are hardwired into the bit-sliced neighbor
+ * count below; keep them in sync with kernel.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "util.h"
+#include "frames.h"
+#include "settings.h"
+#include "goi.h"
+#include "tiny.h"
+#include "kernel.h"
+#include "deathstream.h"
+
+typedef uint64_t bitRow;
+
+/**
+ * A world is an array of planes indexed by dense faction id (see factionMap), 1..nFactions.
+ * Bit (col + 1) of plane[f][row + 1] is set iff the cell at (row, col) belongs to faction f;
+ * bit 0, bit nCols + 1, row 0 and row nRows + 1 are the always-dead border.
+ */
+typedef bitRow tinyPlane[TINY_MAX_ROWS + 2];
+
+bool fitsTinyEngine(int nRows, int nCols)
+{
+    return nRows <= TINY_MAX_ROWS && nCols <= TINY_MAX_COLS;
+}
+
+/**
+ * Loads grid into the (zeroed) world.
+ */
+static void loadTinyWorld(tinyPlane *world, const int *grid, int nRows, int nCols, const factionMap *map)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        for (int col = 0; col < nCols; col++)
+        {
+            int faction = getValueAt(grid, nRows, nCols, row, col);
+            if (faction > DEAD_FACTION && faction < MAX_FACTIONS)
+            {
+                world[map->toDense[faction]][row + 1] |= (bitRow) 1 << (col + 1);
+            }
+        }
+    }
+}
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+static void storeTinyWorld(const tinyPlane *world, int *grid, int nRows, int nCols, const factionMap *map)
+{
+    for (int row = 0; row < nRows; row++)
+    {
+        for (int col = 0; col < nCols; col++)
+        {
+            int cell = DEAD_FACTION;
+            for (int faction = DEAD_FACTION + 1; faction <= map->nFactions; faction++)
+            {
+                if ((world[faction][row + 1] >> (col + 1)) & 1)
+                {
+                    cell = map->toFaction[faction];
+                }
+            }
+            setValueAt(grid, nRows, nCols, row, col, cell);
+        }
+    }
+}
+#endif
+
+/**
+ * Bit-sliced count of the 8 neighbors of every cell in row, given the same plane's rows above and
+ * below. Sets the bits of *two and *three for the cells with exactly 2 and exactly 3 neighbors.
+ */
+static inline void countNeighbors(bitRow above, bitRow row, bitRow below, bitRow *two, bitRow *three)
+{
+    // per-column sums: 0..3 for the rows above and below, 0..2 for this row (which excludes the cell)
+    bitRow aL = above << 1, aR = above >> 1;
+    bitRow cL = below << 1, cR = below >> 1;
+    bitRow bL = row << 1, bR = row >> 1;
+    bitRow a0 = aL ^ above ^ aR, a1 = (aL & above) | (aL & aR) | (above & aR);
+    bitRow c0 = cL ^ below ^ cR, c1 = (cL & below) | (cL & cR) | (below & cR);
+    bitRow b0 = bL ^ bR, b1 = bL & bR;
+
+    // total = ones + 2 * (a1 + b1 + c1 + carry)
+    bitRow ones = a0 ^ b0 ^ c0;
+    bitRow carry = (a0 & b0) | (a0 & c0) | (b0 & c0);
+
+    // exactly one of the four weight-two bits is set
+    bitRow oneTwo = (a1 ^ b1 ^ c1 ^ carry) & ~((a1 & b1) | (c1 & carry));
+
+    *two = oneTwo & ~ones;
+    *three = oneTwo & ones;
+}
+
+static inline bitRow anyNeighbor(bitRow above, bitRow row, bitRow below)
+{
+    return (above << 1) | above | (above >> 1) | (row << 1) | (row >> 1) | (below << 1) | below | (below >> 1);
+}
+
+/**
+ * Computes next from curr and the (optional) invasion landing this generation, and returns the
+ * number of deaths due to fighting.
+ */
+static int stepTiny(const tinyPlane *curr, const tinyPlane *invaders, tinyPlane *next,
+    int nFactions, int nRows, bitRow colMask)
+{
+    int deaths = 0;
+
+    bitRow live[TINY_MAX_ROWS + 2];
+    for (int row = 0; row < nRows + 2; row++)
+    {
+        live[row] = 0;
+        for (int faction = DEAD_FACTION + 1; faction <= nFactions; faction++)
+        {
+            live[row] |= curr[faction][row];
+        }
+    }
+
+    for (int row = 1; row <= nRows; row++)
+    {
+        bitRow landed = 0;
+        if (invaders != NULL)
+        {
+            for (int faction = DEAD_FACTION + 1; faction <= nFactions; faction++)
+            {
+                landed |= invaders[faction][row];
+            }
+            deaths += __builtin_popcountll(landed & live[row]);
+        }
+
+        // when a dead cell can be born into several factions, the highest one wins
+        bitRow born = 0;
+        for (int faction = nFactions; faction > DEAD_FACTION; faction--)
+        {
+            const bitRow *p = curr[faction];
+
+            bitRow two, three;
+            countNeighbors(p[row - 1], p[row], p[row + 1], &two, &three);
+            bitRow hostile = anyNeighbor(live[row - 1] & ~p[row - 1], live[row] & ~p[row], live[row + 1] & ~p[row + 1]);
+
+            bitRow survivors = p[row] & ~hostile & (two | three);
+            bitRow births = three & ~live[row] & ~born & colMask;
+            born |= births;
+            deaths += __builtin_popcountll(p[row] & hostile & ~landed);
+
+            bitRow nextRow = survivors | births;
+            if (invaders != NULL)
+            {
+                nextRow = (nextRow & ~landed) | invaders[faction][row];
+            }
+            next[faction][row] = nextRow;
+        }
+    }
+
+    return deaths;
+}
+
+/**
+ * Same contract as goi, for worlds that fit the tiny engine. Runs on the calling thread only.
+ */
+long long goiTiny(int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans)
+{
+    // death toll due to fighting
+    long long deathToll = 0;
+
+    factionMap map;
+    buildFactionMap(&map, startWorld, nRows, nCols, nInvasions, invasionPlans);
+    int nPlanes = map.nFactions + 1;
+
+    tinyPlane *worlds = calloc((size_t) nPlanes * (2 + nInvasions), sizeof(tinyPlane));
+    if (worlds == NULL)
+    {
+        return -1;
+    }
+    tinyPlane *world = worlds;
+    tinyPlane *newWorld = worlds + nPlanes;
+    tinyPlane *invasions = worlds + 2 * nPlanes;
+
+    loadTinyWorld(world, startWorld, nRows, nCols, &map);
+    for (int i = 0; i < nInvasions; i++)
+    {
+        loadTinyWorld(invasions + (size_t) i * nPlanes, invasionPlans[i], nRows, nCols, &map);
+    }
+
+    bitRow colMask = (((bitRow) 1 << nCols) - 1) << 1;
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+    int grid[TINY_MAX_ROWS * TINY_MAX_COLS];
+    storeTinyWorld(world, grid, nRows, nCols, &map);
+#endif
+
+#if PRINT_GENERATIONS
+    printf("\n=== WORLD 0 ===\n");
+    printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+    exportGeneration(grid, nRows, nCols);
+#endif
+
+    int invasionIndex = 0;
+    for (int i = 1; i <= nGenerations; i++)
+    {
+        // is there an invasion this generation?
+        const tinyPlane *inv = NULL;
+        if (invasionIndex < nInvasions && i == invasionTimes[invasionIndex])
+        {
+            inv = invasions + (size_t) invasionIndex * nPlanes;
+            invasionIndex++;
+        }
+
+        int deaths = stepTiny(world, inv, newWorld, map.nFactions, nRows, colMask);
+        deathToll += deaths;
+#if STREAM_DEATHS
+        recordDeaths(i, deaths);
+#endif
+
+        tinyPlane *tmp = world;
+        world = newWorld;
+        newWorld = tmp;
+
+#if PRINT_GENERATIONS || EXPORT_GENERATIONS
+        storeTinyWorld(world, grid, nRows, nCols, &map);
+#endif
+
+#if PRINT_GENERATIONS
+        printf("\n=== WORLD %d ===\n", i);
+        printWorld(grid, nRows, nCols);
+#endif
+
+#if EXPORT_GENERATIONS
+        exportGeneration(grid, nRows, nCols);
+#endif
+    }
+
+    free(worlds);
+
+    return deathToll;
+}
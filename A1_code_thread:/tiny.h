@@ -0,0 +1,13 @@
+#ifndef TINY_H
+#define TINY_H
+
+#include <stdbool.h>
+
+// largest world the tiny engine takes; a row, plus one dead cell on either side, fits in a 64-bit word
+#define TINY_MAX_ROWS 32
+#define TINY_MAX_COLS 62
+
+bool fitsTinyEngine(int nRows, int nCols);
+long long goiTiny(int nGenerations, const int *startWorld, int nRows, int nCols, int nInvasions, const int *invasionTimes, int **invasionPlans);
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * Combining tree barrier for the workers of goi, which also adds up what each of them found in the
+ * generation (see generationTotals).
+ *
+ * Participants arrive at the leaves of a tree of FAN_IN-way nodes, consecutive ids sharing a leaf.
+ * Each writes its totals into its slot of the node and counts itself in; the last to arrive at a node
+ * combines the slots and carries them up to the parent, the others wait. The last to arrive at the
+ * root publishes the grand totals and releases everyone by bumping the generation. So a node (its
+ * counter and FAN_IN slots, two cache lines) is only fought over by FAN_IN threads, and arriving takes
+ * log(FAN_IN, participants) steps instead of all threads queueing on the single counter of a
+ * pthread_barrier_t.
+ *
+ * Waiters spin on the generation for a while, then sleep on it with futex, so the barrier still
+ * behaves when there are more threads than CPUs.
+ *
+ * Consecutive ids only share cache close by if their threads run close by, which placeThreads sees
+ * to when PIN_THREADS is set: it pins the id-th thread to the id-th allowed CPU in socket, then core
+ * order.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "goi.h"
+#include "alloc.h"
+#include "treebarrier.h"
+
+#define FAN_IN 4
+#define CACHE_LINE 64
+// enough for 4^15 participants
+#define MAX_LEVELS 16
+// how many times a waiter polls before it goes to sleep
+#define SPIN_LIMIT 4000
+
+typedef struct combiningNodeStruct {
+    _Alignas(CACHE_LINE) atomic_int arrived;
+    int nChildren;
+    // index of the parent node, -1 at the root, and which of its slots this node fills
+    int parent;
+    int slotInParent;
+    generationTotals slots[FAN_IN];
+} combiningNode;
+
+struct treeBarrierStruct {
+    combiningNode *nodes;
+    // index of the first node of each level, the leaves being level 0
+    int levelStart[MAX_LEVELS];
+    int spinLimit;
+    _Alignas(CACHE_LINE) atomic_uint generation;
+    generationTotals totals;
+    // waiters asleep on generation; the release only wakes them if there are any
+    atomic_int sleepers;
+};
+
+static int countNodes(int nParticipants, int *levelStart, int *nLevels)
+{
+    int nNodes = 0;
+    int width = nParticipants;
+    int level = 0;
+    do
+    {
+        width = (width + FAN_IN - 1) / FAN_IN;
+        if (levelStart != NULL)
+        {
+            levelStart[level] = nNodes;
+        }
+        nNodes += width;
+        level++;
+    } while (width > 1);
+    if (nLevels != NULL)
+    {
+        *nLevels = level;
+    }
+    return nNodes;
+}
+
+/**
+ * Returns the bytes createTreeBarrier allocates for nParticipants.
+ */
+size_t treeBarrierSize(int nParticipants)
+{
+    // the nodes are aligned by hand, allocBuffer only aligns to 16 bytes
+    return sizeof(treeBarrier) + CACHE_LINE + sizeof(combiningNode) * countNodes(nParticipants, NULL, NULL);
+}
+
+/**
+ * Returns a barrier for nParticipants, with ids 0 to nParticipants - 1, or NULL if out of memory.
+ */
+treeBarrier *createTreeBarrier(int nParticipants)
+{
+    char *buffer = allocBuffer(treeBarrierSize(nParticipants));
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    treeBarrier *barrier = (treeBarrier *) buffer;
+    uintptr_t nodes = (uintptr_t) (buffer + sizeof(treeBarrier));
+    barrier->nodes = (combiningNode *) ((nodes + CACHE_LINE - 1) & ~(uintptr_t) (CACHE_LINE - 1));
+
+    int nLevels;
+    countNodes(nParticipants, barrier->levelStart, &nLevels);
+    int width = nParticipants;
+    for (int level = 0; level < nLevels; level++)
+    {
+        int nNodes = (width + FAN_IN - 1) / FAN_IN;
+        for (int i = 0; i < nNodes; i++)
+        {
+            combiningNode *node = &barrier->nodes[barrier->levelStart[level] + i];
+            atomic_init(&node->arrived, 0);
+            node->nChildren = i < nNodes - 1 ? FAN_IN : width - i * FAN_IN;
+            node->parent = level + 1 < nLevels ? barrier->levelStart[level + 1] + i / FAN_IN : -1;
+            node->slotInParent = i % FAN_IN;
+        }
+        width = nNodes;
+    }
+
+    // spinning for a thread that is not running only delays it
+    long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    barrier->spinLimit = nCpus >= nParticipants ? SPIN_LIMIT : 0;
+    atomic_init(&barrier->generation, 0);
+    atomic_init(&barrier->sleepers, 0);
+    return barrier;
+}
+
+void freeTreeBarrier(treeBarrier *barrier)
+{
+    if (barrier == NULL)
+    {
+        return;
+    }
+    freeBuffer(barrier);
+}
+
+static generationTotals combineSlots(const combiningNode *node)
+{
+    generationTotals sum = node->slots[0];
+    for (int i = 1; i < node->nChildren; i++)
+    {
+        sum.deaths += node->slots[i].deaths;
+        sum.liveBox = unionBox(sum.liveBox, node->slots[i].liveBox);
+    }
+    return sum;
+}
+
+/**
+ * Waits until all participants have called treeBarrierWait, and returns the sum of the totals they
+ * passed in as mine. id is the caller's participant id.
+ */
+generationTotals treeBarrierWait(treeBarrier *barrier, int id, generationTotals mine)
+{
+    // cannot move on before this call arrives, so reading it first is safe
+    unsigned generation = atomic_load_explicit(&barrier->generation, memory_order_acquire);
+
+    combiningNode *node = &barrier->nodes[id / FAN_IN];
+    int slot = id % FAN_IN;
+    while (true)
+    {
+        node->slots[slot] = mine;
+        // the last arrival acquires the slots the others released
+        int arrived = atomic_fetch_add_explicit(&node->arrived, 1, memory_order_acq_rel) + 1;
+        if (arrived < node->nChildren)
+        {
+            break;
+        }
+
+        // nobody touches the node again before the release below
+        atomic_store_explicit(&node->arrived, 0, memory_order_relaxed);
+        mine = combineSlots(node);
+        if (node->parent < 0)
+        {
+            barrier->totals = mine;
+            // sequentially consistent against the waiters' sleepers then generation: either they see
+            // the new generation or this sees them asleep
+            atomic_store(&barrier->generation, generation + 1);
+            if (atomic_load(&barrier->sleepers) > 0)
+            {
+                syscall(SYS_futex, &barrier->generation, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+            }
+            return mine;
+        }
+        slot = node->slotInParent;
+        node = &barrier->nodes[node->parent];
+    }
+
+    for (int spin = 0; spin < barrier->spinLimit; spin++)
+    {
+        if (atomic_load_explicit(&barrier->generation, memory_order_acquire) != generation)
+        {
+            return barrier->totals;
+        }
+    }
+    atomic_fetch_add(&barrier->sleepers, 1);
+    while (atomic_load(&barrier->generation) == generation)
+    {
+        // returns at once if the generation moved on in between
+        syscall(SYS_futex, &barrier->generation, FUTEX_WAIT_PRIVATE, generation, NULL, NULL, 0);
+    }
+    atomic_fetch_sub(&barrier->sleepers, 1);
+    return barrier->totals;
+}
+
+typedef struct cpuPlaceStruct {
+    int cpu;
+    int package;
+    int core;
+} cpuPlace;
+
+static int readTopology(int cpu, const char *name)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *fp = fopen(path, "r");
+    int value = -1;
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%d", &value) != 1)
+        {
+            value = -1;
+        }
+        fclose(fp);
+    }
+    return value;
+}
+
+static int comparePlaces(const void *a, const void *b)
+{
+    const cpuPlace *pa = a;
+    const cpuPlace *pb = b;
+    if (pa->package != pb->package) return pa->package < pb->package ? -1 : 1;
+    if (pa->core != pb->core) return pa->core < pb->core ? -1 : 1;
+    return pa->cpu - pb->cpu;
+}
+
+/**
+ * Pins threads[id] to a CPU such that consecutive ids run on the same core or socket where possible.
+ * Leaves them be if there are fewer allowed CPUs than threads; a thread that cannot be pinned just
+ * runs anywhere.
+ */
+void placeThreads(const pthread_t *threads, int nThreads)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) < nThreads)
+    {
+        return;
+    }
+
+    cpuPlace places[CPU_SETSIZE];
+    int nPlaces = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            places[nPlaces].cpu = cpu;
+            places[nPlaces].package = readTopology(cpu, "physical_package_id");
+            places[nPlaces].core = readTopology(cpu, "core_id");
+            nPlaces++;
+        }
+    }
+    qsort(places, nPlaces, sizeof(cpuPlace), comparePlaces);
+
+    for (int id = 0; id < nThreads; id++)
+    {
+        cpu_set_t target;
+        CPU_ZERO(&target);
+        CPU_SET(places[id].cpu, &target);
+        pthread_setaffinity_np(threads[id], sizeof(target), &target);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef TREEBARRIER_H
+#define TREEBARRIER_H
+
+#include <pthread.h>
+#include "goi.h"
+
+/**
+ * What the participants of a generation add up at the barrier.
+ */
+typedef struct generationTotalsStruct {
+    long long deaths;
+    box liveBox;
+} generationTotals;
+
+typedef struct treeBarrierStruct treeBarrier;
+
+size_t treeBarrierSize(int nParticipants);
+treeBarrier *createTreeBarrier(int nParticipants);
+void freeTreeBarrier(treeBarrier *barrier);
+
+generationTotals treeBarrierWait(treeBarrier *barrier, int id, generationTotals mine);
+void placeThreads(const pthread_t *threads, int nThreads);
+
+#endif
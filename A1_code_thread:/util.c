@@ -21,7 +21,7 @@ int getValueAt(const int *grid, int nRows, int nCols, int row, int col)
         return -1;
     }
 
-    return *(grid + (row * nCols) + col);
+    return *(grid + ((size_t) row * nCols) + col);
 }
 
 /**
@@ -36,7 +36,7 @@ void setValueAt(int *grid, int nRows, int nCols, int row, int col, int val)
         return;
     }
 
-    *(grid + (row * nCols) + col) = val;
+    *(grid + ((size_t) row * nCols) + col) = val;
 }
 
 /**
@@ -48,7 +48,7 @@ void printWorld(const int *world, int nRows, int nCols)
     {
         for (int col = 0; col < nCols; col++)
         {
-            printf("%d ", *(world + (row * nCols) + col));
+            printf("%d ", *(world + ((size_t) row * nCols) + col));
         }
         printf("\n");
     }